@@ -0,0 +1,158 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include "mapped_file.h"
+#include "profile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path, std::size_t padding)
+    : m_data(nullptr), m_size(0), m_mappedSize(0), m_isOpen(false), m_isMapped(false)
+{
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return;
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        if (padding == 0)
+        {
+            void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+                m_data = static_cast<unsigned char*>(data);
+                m_mappedSize = st.st_size;
+            }
+        }
+        else
+        {
+            // Reserve zeroed pages for the padding and map the file over the start of them.
+            // The rest of the file's last page is zero-filled by mmap.
+            long pageSize = sysconf(_SC_PAGESIZE);
+            std::size_t mappedSize = (st.st_size + padding + pageSize - 1) / pageSize * pageSize;
+            void* region = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (region != MAP_FAILED)
+            {
+                void* data = mmap(region, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+
+                if (data != MAP_FAILED)
+                {
+                    m_data = static_cast<unsigned char*>(data);
+                    m_mappedSize = mappedSize;
+                }
+                else
+                {
+                    munmap(region, mappedSize);
+                }
+            }
+        }
+
+        if (m_data != nullptr)
+        {
+            m_size = st.st_size;
+            m_isOpen = true;
+            m_isMapped = true;
+            PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+            PROFILE_COUNT(PROFILE_BYTES_READ, m_size);
+        }
+    }
+
+    close(fd);
+
+    if (m_isOpen)
+        return;
+#endif
+
+    FILE* fp = std::fopen(path.c_str(), "rb");
+
+    if (fp == nullptr)
+        return;
+
+    std::fseek(fp, 0, SEEK_END);
+
+    long size = std::ftell(fp);
+
+    if (size < 0)
+    {
+        std::fclose(fp);
+        return;
+    }
+
+    unsigned char* buffer = new unsigned char[size + padding + 1]();
+
+    std::rewind(fp);
+
+    if (size > 0 && std::fread(buffer, size, 1, fp) != 1)
+    {
+        delete[] buffer;
+        std::fclose(fp);
+        return;
+    }
+
+    std::fclose(fp);
+
+    m_data = buffer;
+    m_size = size;
+    m_isOpen = true;
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_READ, m_size);
+    PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if (m_isMapped)
+    {
+        munmap(m_data, m_mappedSize);
+        return;
+    }
+#endif
+
+    delete[] m_data;
+}
+
+// Gets the size and modification time of a file.
+// Returns false if the file doesn't exist.
+bool GetFileInfo(const std::string& path, long& size, long& mtime)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+    size = static_cast<long>(st.st_size);
+    mtime = static_cast<long>(st.st_mtime);
+
+    return true;
+}
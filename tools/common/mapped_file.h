@@ -0,0 +1,69 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// A view of a whole file.
+// The file is mapped into memory where that's supported and read otherwise.
+// If padding is given, the contents are followed by at least that many zero bytes
+// and can be modified without affecting the file (pages are copied on write).
+class MappedFile
+{
+public:
+    MappedFile(const std::string& path, std::size_t padding = 0);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool IsOpen() const
+    {
+        return m_isOpen;
+    }
+
+    const unsigned char* Data() const
+    {
+        return m_data;
+    }
+
+    unsigned char* MutableData()
+    {
+        return m_data;
+    }
+
+    std::size_t Size() const
+    {
+        return m_size;
+    }
+
+private:
+    unsigned char* m_data;
+    std::size_t m_size;
+    std::size_t m_mappedSize;
+    bool m_isOpen;
+    bool m_isMapped;
+};
+
+bool GetFileInfo(const std::string& path, long& size, long& mtime);
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,356 @@
+// profile.c
+//
+// Events are kept in memory and written to the trace file in one append at exit.
+// This file is also compiled as C++ by the C++ tools.
+
+// For clock_gettime and flock under -std=c11.
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// MSVC has no __thread or __sync builtins, so use its own spellings there.
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define THREAD_LOCAL __declspec(thread)
+#define ATOMIC_SWAP(p, v) InterlockedExchange((p), (v))
+#define ATOMIC_INCREMENT(p) InterlockedIncrement(p)
+#define ATOMIC_ADD_64(p, v) InterlockedExchangeAdd64((p), (v))
+#else
+#define THREAD_LOCAL __thread
+#define ATOMIC_SWAP(p, v) __sync_lock_test_and_set((p), (v))
+#define ATOMIC_INCREMENT(p) __sync_add_and_fetch((p), 1)
+#define ATOMIC_ADD_64(p, v) __sync_add_and_fetch((p), (v))
+#endif
+
+#include "profile.h"
+
+#define DEFAULT_TRACE_FILE "profile.json"
+
+struct ProfileEvent
+{
+    const char *name;
+    char *detail;
+    long long start;
+    long long duration;
+    int thread;
+};
+
+int g_profileEnabled = 0;
+
+static const char *s_counterNames[PROFILE_COUNTER_COUNT] =
+{
+    "files opened",
+    "bytes read",
+    "bytes written",
+    "matches searched",
+    "allocations",
+};
+
+static const char *s_traceFile;
+static char *s_processName;
+static long long s_processStart;
+static long long s_counters[PROFILE_COUNTER_COUNT];
+static struct ProfileEvent *s_events;
+static int s_numEvents;
+static int s_maxEvents;
+static volatile long s_lock;
+static volatile long s_nextThread;
+static THREAD_LOCAL int s_thread;
+
+static long long GetMicroseconds(void)
+{
+    struct timespec ts;
+
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static char *CopyString(const char *s)
+{
+    char *copy = (char *)malloc(strlen(s) + 1);
+
+    if (copy != NULL)
+        strcpy(copy, s);
+
+    return copy;
+}
+
+static void Lock(void)
+{
+    while (ATOMIC_SWAP(&s_lock, 1))
+        ;
+}
+
+static void Unlock(void)
+{
+    ATOMIC_SWAP(&s_lock, 0);
+}
+
+// Appends s to buffer as a JSON string.
+static void AppendJsonString(char **buffer, size_t *length, size_t *capacity, const char *s)
+{
+    size_t needed = *length + strlen(s) * 6 + 3;
+
+    if (needed > *capacity)
+    {
+        *capacity = needed * 2;
+        *buffer = (char *)realloc(*buffer, *capacity);
+        if (*buffer == NULL)
+            abort();
+    }
+
+    (*buffer)[(*length)++] = '"';
+
+    for (; *s != 0; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+
+        if (c == '"' || c == '\\')
+        {
+            (*buffer)[(*length)++] = '\\';
+            (*buffer)[(*length)++] = c;
+        }
+        else if (c < 0x20)
+        {
+            *length += sprintf(*buffer + *length, "\\u%04x", c);
+        }
+        else
+        {
+            (*buffer)[(*length)++] = c;
+        }
+    }
+
+    (*buffer)[(*length)++] = '"';
+}
+
+static void AppendFormat(char **buffer, size_t *length, size_t *capacity, const char *format, long long a, long long b, long long c, long long d)
+{
+    if (*length + 128 > *capacity)
+    {
+        *capacity = (*length + 128) * 2;
+        *buffer = (char *)realloc(*buffer, *capacity);
+        if (*buffer == NULL)
+            abort();
+    }
+
+    *length += sprintf(*buffer + *length, format, a, b, c, d);
+}
+
+// Writes text to the end of the trace file, starting the JSON array if the file is new.
+// The closing bracket is left off, which trace viewers accept, so that later runs can append.
+static void AppendToTraceFile(const char *text, size_t length)
+{
+#ifdef _WIN32
+    FILE *fp = fopen(s_traceFile, "ab");
+
+    if (fp == NULL)
+        return;
+
+    fseek(fp, 0, SEEK_END);
+    if (ftell(fp) == 0)
+        fputs("[\n", fp);
+    fwrite(text, 1, length, fp);
+    fclose(fp);
+#else
+    int fd = open(s_traceFile, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    struct stat st;
+
+    if (fd < 0)
+        return;
+
+    // Other tools in the same build may be appending at the same time.
+    flock(fd, LOCK_EX);
+
+    if (fstat(fd, &st) == 0 && st.st_size == 0 && write(fd, "[\n", 2) != 2)
+        length = 0;
+
+    while (length > 0)
+    {
+        ssize_t written = write(fd, text, length);
+
+        if (written <= 0)
+            break;
+
+        text += written;
+        length -= written;
+    }
+
+    close(fd);
+#endif
+}
+
+static void WriteTrace(void)
+{
+    char *buffer = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    long long pid = getpid();
+    long long end = GetMicroseconds();
+    int i;
+
+    Lock();
+
+    AppendFormat(&buffer, &length, &capacity, "{\"ph\":\"M\",\"pid\":%lld,\"name\":\"process_name\",\"args\":{\"name\":", pid, 0, 0, 0);
+    AppendJsonString(&buffer, &length, &capacity, s_processName);
+    AppendFormat(&buffer, &length, &capacity, "}},\n", 0, 0, 0, 0);
+
+    // The whole run, on the main thread, with the counter totals as its arguments.
+    AppendFormat(&buffer, &length, &capacity, "{\"ph\":\"X\",\"pid\":%lld,\"tid\":1,\"ts\":%lld,\"dur\":%lld,\"name\":", pid, s_processStart, end - s_processStart, 0);
+    AppendJsonString(&buffer, &length, &capacity, s_processName);
+    AppendFormat(&buffer, &length, &capacity, ",\"args\":{", 0, 0, 0, 0);
+
+    for (i = 0; i < PROFILE_COUNTER_COUNT; i++)
+    {
+        if (i != 0)
+            AppendFormat(&buffer, &length, &capacity, ",", 0, 0, 0, 0);
+        AppendJsonString(&buffer, &length, &capacity, s_counterNames[i]);
+        AppendFormat(&buffer, &length, &capacity, ":%lld", s_counters[i], 0, 0, 0);
+    }
+
+    AppendFormat(&buffer, &length, &capacity, "}},\n", 0, 0, 0, 0);
+
+    for (i = 0; i < s_numEvents; i++)
+    {
+        struct ProfileEvent *event = &s_events[i];
+
+        AppendFormat(&buffer, &length, &capacity, "{\"ph\":\"X\",\"pid\":%lld,\"tid\":%lld,\"ts\":%lld,\"dur\":%lld,\"name\":",
+                     pid, event->thread, event->start, event->duration);
+        AppendJsonString(&buffer, &length, &capacity, event->name);
+
+        if (event->detail != NULL)
+        {
+            AppendFormat(&buffer, &length, &capacity, ",\"args\":{\"detail\":", 0, 0, 0, 0);
+            AppendJsonString(&buffer, &length, &capacity, event->detail);
+            AppendFormat(&buffer, &length, &capacity, "}", 0, 0, 0, 0);
+        }
+
+        AppendFormat(&buffer, &length, &capacity, "},\n", 0, 0, 0, 0);
+    }
+
+    Unlock();
+
+    AppendToTraceFile(buffer, length);
+    free(buffer);
+}
+
+void ProfileInit(const char *toolName, int *argc, char **argv)
+{
+    size_t nameLength = strlen(toolName) + 1;
+    int i, j;
+
+    s_traceFile = getenv("TOOL_PROFILE");
+    if (s_traceFile != NULL && *s_traceFile == 0)
+        s_traceFile = NULL;
+
+    for (i = 1, j = 1; i < *argc; i++)
+    {
+        if (strcmp(argv[i], "--profile") == 0)
+        {
+            if (s_traceFile == NULL)
+                s_traceFile = DEFAULT_TRACE_FILE;
+        }
+        else if (strncmp(argv[i], "--profile=", 10) == 0)
+        {
+            s_traceFile = argv[i] + 10;
+        }
+        else
+        {
+            argv[j++] = argv[i];
+        }
+    }
+
+    *argc = j;
+    argv[j] = NULL;
+
+    if (s_traceFile == NULL)
+        return;
+
+    // Name the process after the tool and its arguments, so runs can be told apart.
+    for (i = 1; i < *argc; i++)
+        nameLength += strlen(argv[i]) + 1;
+
+    s_processName = (char *)malloc(nameLength);
+    if (s_processName == NULL)
+        return;
+
+    strcpy(s_processName, toolName);
+    for (i = 1; i < *argc; i++)
+    {
+        strcat(s_processName, " ");
+        strcat(s_processName, argv[i]);
+    }
+
+    s_thread = s_nextThread = 1;
+    s_processStart = GetMicroseconds();
+    g_profileEnabled = 1;
+    atexit(WriteTrace);
+}
+
+long long ProfileBegin(void)
+{
+    return g_profileEnabled ? GetMicroseconds() : 0;
+}
+
+void ProfileEnd(const char *name, const char *detail, long long start)
+{
+    long long end;
+
+    if (!g_profileEnabled)
+        return;
+
+    end = GetMicroseconds();
+
+    if (s_thread == 0)
+        s_thread = (int)ATOMIC_INCREMENT(&s_nextThread);
+
+    Lock();
+
+    if (s_numEvents == s_maxEvents)
+    {
+        int maxEvents = s_maxEvents ? s_maxEvents * 2 : 256;
+        struct ProfileEvent *events = (struct ProfileEvent *)realloc(s_events, maxEvents * sizeof(*events));
+
+        if (events == NULL)
+        {
+            Unlock();
+            return;
+        }
+
+        s_events = events;
+        s_maxEvents = maxEvents;
+    }
+
+    s_events[s_numEvents].name = name;
+    s_events[s_numEvents].detail = detail ? CopyString(detail) : NULL;
+    s_events[s_numEvents].start = start;
+    s_events[s_numEvents].duration = end - start;
+    s_events[s_numEvents].thread = s_thread;
+    s_numEvents++;
+
+    Unlock();
+}
+
+void ProfileCount(enum ProfileCounter counter, long long amount)
+{
+    if (g_profileEnabled)
+        ATOMIC_ADD_64(&s_counters[counter], amount);
+}
@@ -0,0 +1,68 @@
+// profile.h
+//
+// Lightweight timing and counters shared by the host tools.
+//
+// Profiling is off unless the TOOL_PROFILE environment variable names a trace
+// file or the tool is run with --profile[=FILE]. When it's on, the tool appends
+// its timed scopes and counter totals to the file as Chrome trace events, so a
+// whole build can be loaded into chrome://tracing or Perfetto. Processes
+// append to the same file, so use an absolute path when make changes directory.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ProfileCounter
+{
+    PROFILE_FILES_OPENED,
+    PROFILE_BYTES_READ,
+    PROFILE_BYTES_WRITTEN,
+    PROFILE_MATCHES_SEARCHED,
+    PROFILE_ALLOCATIONS,
+    PROFILE_COUNTER_COUNT
+};
+
+extern int g_profileEnabled;
+
+// Turn profiling on if it's been asked for, and take --profile[=FILE] out of
+// argv so the tool's own option parsing never sees it. The trace is written at exit.
+void ProfileInit(const char *toolName, int *argc, char **argv);
+
+// Timestamp in microseconds, or 0 if profiling is off.
+long long ProfileBegin(void);
+// Record a scope that started at start. name isn't copied, so it should be a string literal.
+// detail is copied and shown as the scope's argument, and may be NULL.
+void ProfileEnd(const char *name, const char *detail, long long start);
+void ProfileCount(enum ProfileCounter counter, long long amount);
+
+#define PROFILE_COUNT(counter, amount)              \
+do {                                                \
+    if (g_profileEnabled)                           \
+        ProfileCount(counter, (long long)(amount)); \
+} while (0)
+
+#ifdef __cplusplus
+}
+
+// Times the enclosing scope.
+class ProfileScope
+{
+public:
+    ProfileScope(const char *name, const char *detail = nullptr)
+        : m_name(name), m_detail(detail), m_start(ProfileBegin()) {}
+    ~ProfileScope() { if (g_profileEnabled) ProfileEnd(m_name, m_detail, m_start); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char *m_name;
+    const char *m_detail;
+    long long m_start;
+};
+#endif
+
+#endif // PROFILE_H
@@ -0,0 +1,249 @@
+//---------------------------------------------------------------------------------
+// checksum.c
+//---------------------------------------------------------------------------------
+/*
+    Whole-ROM checksums for gbafix.
+
+    The sum, CRC-32 and SHA-1 are taken in a single pass over the image, one
+    cache-sized chunk at a time, so each byte is only brought in from memory once.
+    CRC-32 uses slicing-by-8 tables and the sum works on 8 bytes at a time.
+*/
+
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "checksum.h"
+
+#define ROTL(x, n)    (((x) << (n)) | ((x) >> (32 - (n))))
+#define CHUNK_SIZE    0x10000
+
+static uint32_t crc_table[8][256];
+#ifdef _WIN32
+static int crc_table_ready = 0;     // --batch runs on one thread there
+#else
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;    // --batch workers digest ROMs at the same time
+#endif
+
+//---------------------------------------------------------------------------------
+static void InitCrcTable(void)
+//---------------------------------------------------------------------------------
+{
+    int n, k;
+
+    for (n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        crc_table[0][n] = c;
+    }
+
+    for (n = 0; n < 256; n++)
+        for (k = 1; k < 8; k++)
+            crc_table[k][n] = (crc_table[k - 1][n] >> 8) ^ crc_table[0][crc_table[k - 1][n] & 0xFF];
+
+#ifdef _WIN32
+    crc_table_ready = 1;
+#endif
+}
+
+//---------------------------------------------------------------------------------
+uint32_t Crc32Update(uint32_t crc, const uint8_t *p, size_t size)
+//---------------------------------------------------------------------------------
+{
+#ifdef _WIN32
+    if (!crc_table_ready)
+        InitCrcTable();
+#else
+    pthread_once(&crc_table_once, InitCrcTable);
+#endif
+
+    crc = ~crc;
+
+    while (size >= 8)
+    {
+        uint32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t)p[7] << 24;
+
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF]
+            ^ crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24]
+            ^ crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF]
+            ^ crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+
+    while (size--)
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+//---------------------------------------------------------------------------------
+static void Sha1Block(uint32_t state[5], const uint8_t *p)
+//---------------------------------------------------------------------------------
+{
+    uint32_t w[80];
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[i * 4] << 24 | p[i * 4 + 1] << 16 | p[i * 4 + 2] << 8 | p[i * 4 + 3];
+
+    for (i = 16; i < 80; i++)
+        w[i] = ROTL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    for (i = 0; i < 80; i++)
+    {
+        uint32_t f, k, t;
+
+        if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+        else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+        else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+        else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+
+        t = ROTL(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROTL(b, 30);
+        b = a;
+        a = t;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+//---------------------------------------------------------------------------------
+void Sha1Init(Sha1Context *ctx)
+//---------------------------------------------------------------------------------
+{
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xEFCDAB89;
+    ctx->state[2] = 0x98BADCFE;
+    ctx->state[3] = 0x10325476;
+    ctx->state[4] = 0xC3D2E1F0;
+    ctx->length = 0;
+}
+
+//---------------------------------------------------------------------------------
+void Sha1Update(Sha1Context *ctx, const uint8_t *data, size_t size)
+//---------------------------------------------------------------------------------
+{
+    size_t used = ctx->length & 63;
+
+    ctx->length += size;
+
+    if (used)
+    {
+        size_t n = 64 - used;
+        if (n > size) n = size;
+        memcpy(ctx->block + used, data, n);
+        data += n;
+        size -= n;
+        if (used + n < 64) return;
+        Sha1Block(ctx->state, ctx->block);
+    }
+
+    for (; size >= 64; data += 64, size -= 64)
+        Sha1Block(ctx->state, data);
+
+    memcpy(ctx->block, data, size);
+}
+
+//---------------------------------------------------------------------------------
+void Sha1Final(Sha1Context *ctx, uint8_t digest[20])
+//---------------------------------------------------------------------------------
+{
+    uint64_t bits = ctx->length * 8;
+    uint8_t pad[72];
+    size_t padSize = 64 - ((ctx->length + 8) & 63);
+    int i;
+
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (i = 0; i < 8; i++)
+        pad[padSize + i] = (uint8_t)(bits >> (56 - i * 8));
+
+    Sha1Update(ctx, pad, padSize + 8);
+
+    for (i = 0; i < 20; i++)
+        digest[i] = (uint8_t)(ctx->state[i / 4] >> (24 - (i % 4) * 8));
+}
+
+//---------------------------------------------------------------------------------
+static uint32_t SumBytes(const uint8_t *p, size_t size)
+//---------------------------------------------------------------------------------
+{
+    uint32_t sum = 0;
+
+    // Add 8 bytes at a time into four 16-bit lanes, folding them
+    // into the sum before they can overflow.
+    while (size >= 8)
+    {
+        size_t n = size / 8 > 0x80 ? 0x80 : size / 8;
+        uint64_t acc = 0;
+
+        size -= n * 8;
+
+        while (n--)
+        {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            acc += word & 0x00FF00FF00FF00FFULL;
+            acc += (word >> 8) & 0x00FF00FF00FF00FFULL;
+            p += 8;
+        }
+
+        sum += (uint32_t)(acc & 0xFFFF) + (uint32_t)((acc >> 16) & 0xFFFF)
+             + (uint32_t)((acc >> 32) & 0xFFFF) + (uint32_t)(acc >> 48);
+    }
+
+    while (size--)
+        sum += *p++;
+
+    return sum;
+}
+
+//---------------------------------------------------------------------------------
+void DigestRom(const uint8_t *data, size_t size, RomDigest *digest)
+//---------------------------------------------------------------------------------
+{
+    Sha1Context sha1;
+    size_t pos;
+
+    Sha1Init(&sha1);
+    digest->sum = 0;
+    digest->crc32 = 0;
+
+    for (pos = 0; pos < size; pos += CHUNK_SIZE)
+    {
+        size_t n = size - pos < CHUNK_SIZE ? size - pos : CHUNK_SIZE;
+
+        digest->sum += SumBytes(data + pos, n);
+        digest->crc32 = Crc32Update(digest->crc32, data + pos, n);
+        Sha1Update(&sha1, data + pos, n);
+    }
+
+    Sha1Final(&sha1, digest->sha1);
+}
+
+//---------------------------------------------------------------------------------
+void FormatSha1(const uint8_t digest[20], char text[41])
+//---------------------------------------------------------------------------------
+{
+    static const char hex[] = "0123456789abcdef";
+    int i;
+
+    for (i = 0; i < 20; i++)
+    {
+        text[i * 2] = hex[digest[i] >> 4];
+        text[i * 2 + 1] = hex[digest[i] & 0xF];
+    }
+
+    text[40] = 0;
+}
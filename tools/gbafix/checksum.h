@@ -0,0 +1,35 @@
+//---------------------------------------------------------------------------------
+// checksum.h
+//---------------------------------------------------------------------------------
+/*
+    Whole-ROM checksums for gbafix.
+*/
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t    state[5];
+    uint64_t    length;             // bytes hashed so far
+    uint8_t     block[64];          // partial block
+} Sha1Context;
+
+typedef struct
+{
+    uint32_t    sum;                // 32-bit sum of every byte
+    uint32_t    crc32;              // zlib/PNG CRC-32
+    uint8_t     sha1[20];
+} RomDigest;
+
+void Sha1Init(Sha1Context *ctx);
+void Sha1Update(Sha1Context *ctx, const uint8_t *data, size_t size);
+void Sha1Final(Sha1Context *ctx, uint8_t digest[20]);
+uint32_t Crc32Update(uint32_t crc, const uint8_t *data, size_t size);
+void DigestRom(const uint8_t *data, size_t size, RomDigest *digest);
+void FormatSha1(const uint8_t digest[20], char text[41]);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,106 @@
+//---------------------------------------------------------------------------------
+// elf_image.c
+//---------------------------------------------------------------------------------
+/*
+    Flat binary images of ELF files, as objcopy -O binary makes them.
+
+    Each allocated section with contents goes at its load address, relative to
+    the lowest one, and the gaps are zero. The load address comes from the
+    PT_LOAD segment that holds the section. Sections are used rather than the
+    segments themselves because a segment's file size can cover bytes that
+    objcopy wouldn't copy.
+*/
+
+#include <string.h>
+#include "elf.h"
+#include "elf_image.h"
+
+//---------------------------------------------------------------------------------
+static uint32_t GetLoadAddress(const ElfImage *image, const Elf32_Ehdr *elfHeader, const Elf32_Shdr *secHeader)
+//---------------------------------------------------------------------------------
+{
+    Elf32_Phdr progHeader;
+    int i;
+
+    for (i = 0; i < elfHeader->e_phnum; i++)
+    {
+        memcpy(&progHeader, image->elf + elfHeader->e_phoff + i * sizeof(progHeader), sizeof(progHeader));
+        if (progHeader.p_type == PT_LOAD
+         && secHeader->sh_offset >= progHeader.p_offset
+         && secHeader->sh_offset + secHeader->sh_size <= progHeader.p_offset + progHeader.p_filesz
+         && secHeader->sh_addr >= progHeader.p_vaddr)
+            return secHeader->sh_addr - progHeader.p_vaddr + progHeader.p_paddr;
+    }
+
+    return secHeader->sh_addr;
+}
+
+//---------------------------------------------------------------------------------
+static int GetSection(const ElfImage *image, const Elf32_Ehdr *elfHeader, int i, Elf32_Shdr *secHeader)
+/*---------------------------------------------------------------------------------
+    Read section header i. Returns 1 if it's part of the image
+---------------------------------------------------------------------------------*/
+{
+    memcpy(secHeader, image->elf + elfHeader->e_shoff + i * sizeof(*secHeader), sizeof(*secHeader));
+    return (secHeader->sh_flags & SHF_ALLOC) && secHeader->sh_type != SHT_NOBITS && secHeader->sh_size != 0;
+}
+
+//---------------------------------------------------------------------------------
+const char *GetElfImage(ElfImage *image, const uint8_t *elf, size_t elfSize)
+//---------------------------------------------------------------------------------
+{
+    Elf32_Ehdr elfHeader;
+    Elf32_Shdr secHeader;
+    uint32_t start = 0xFFFFFFFF, end = 0;
+    int i;
+
+    image->elf = elf;
+    image->elfSize = elfSize;
+
+    if (elfSize < sizeof(elfHeader) || memcmp(elf, ELFMAG, 4) != 0
+     || elf[EI_CLASS] != ELFCLASS32 || elf[EI_DATA] != ELFDATA2LSB)
+        return "Error: not a 32-bit little-endian ELF!";
+
+    memcpy(&elfHeader, elf, sizeof(elfHeader));
+
+    if (elfHeader.e_shoff > elfSize || (size_t)elfHeader.e_shnum * sizeof(secHeader) > elfSize - elfHeader.e_shoff
+     || elfHeader.e_phoff > elfSize || (size_t)elfHeader.e_phnum * sizeof(Elf32_Phdr) > elfSize - elfHeader.e_phoff)
+        return "Error: bad ELF header table!";
+
+    for (i = 0; i < elfHeader.e_shnum; i++)
+    {
+        uint32_t lma;
+
+        if (!GetSection(image, &elfHeader, i, &secHeader)) continue;
+
+        if (secHeader.sh_offset > elfSize || secHeader.sh_size > elfSize - secHeader.sh_offset)
+            return "Error: ELF section is out of range!";
+
+        lma = GetLoadAddress(image, &elfHeader, &secHeader);
+        if (lma < start) start = lma;
+        if (lma + secHeader.sh_size > end) end = lma + secHeader.sh_size;
+    }
+
+    if (end <= start) return "Error: ELF has nothing to load!";
+
+    image->start = start;
+    image->size = end - start;
+    return NULL;
+}
+
+//---------------------------------------------------------------------------------
+void CopyElfImage(const ElfImage *image, uint8_t *dest)
+//---------------------------------------------------------------------------------
+{
+    Elf32_Ehdr elfHeader;
+    Elf32_Shdr secHeader;
+    int i;
+
+    memcpy(&elfHeader, image->elf, sizeof(elfHeader));
+
+    for (i = 0; i < elfHeader.e_shnum; i++)
+    {
+        if (!GetSection(image, &elfHeader, i, &secHeader)) continue;
+        memcpy(dest + (GetLoadAddress(image, &elfHeader, &secHeader) - image->start), image->elf + secHeader.sh_offset, secHeader.sh_size);
+    }
+}
@@ -0,0 +1,27 @@
+//---------------------------------------------------------------------------------
+// elf_image.h
+//---------------------------------------------------------------------------------
+/*
+    Flat binary images of ELF files, as objcopy -O binary makes them.
+*/
+
+#ifndef ELF_IMAGE_H
+#define ELF_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    const uint8_t  *elf;            // the whole ELF file
+    size_t          elfSize;
+    uint32_t        start;          // lowest load address
+    uint32_t        size;           // size of the image
+} ElfImage;
+
+// Check the ELF and find the extent of its image. Returns an error message, or NULL.
+const char *GetElfImage(ElfImage *image, const uint8_t *elf, size_t elfSize);
+// Copy the image into dest, which must hold image->size bytes and be zeroed.
+void CopyElfImage(const ElfImage *image, uint8_t *dest);
+
+#endif // ELF_IMAGE_H
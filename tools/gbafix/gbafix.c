@@ -33,6 +33,8 @@
 
     History
     -------
+    v1.09 - added --elf, --keep-header and --lz
+    v1.08 - fix the header in place, added --checksums and --verify, --batch
     v1.07 - added support for ELF input, (PikalaxALT)
     v1.06 - added output silencing, (Sierraffinity)
     v1.05 - added debug offset argument, (Sierraffinity)
@@ -43,19 +45,30 @@
     v1.00 - logo, complement
 */
 
-#pragma pack(1)
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
 #include "elf.h"
+#include "checksum.h"
+#include "elf_image.h"
+#include "lz.h"
+#include "profile.h"
 
-#define VER        "1.07"
+#define VER        "1.09"
 #define ARGV    argv[arg]
 #define VALUE    (ARGV+2)
 #define NUMBER    strtoul(VALUE, NULL, 0)
 
+// Only the header is packed, since it's overlaid on the ROM.
+#pragma pack(push, 1)
 typedef struct
 {
     uint32_t    start_code;            // B instruction
@@ -71,10 +84,9 @@ typedef struct
     uint8_t        complement;            // 800000A0..800000BC
     uint16_t    checksum;            // 0x0000
 } Header;
+#pragma pack(pop)
 
 
-Header header;
-
 unsigned short checksum_without_header = 0;
 
 const Header good_header =
@@ -115,14 +127,14 @@ const Header good_header =
 };
 
 //---------------------------------------------------------------------------------
-char HeaderComplement()
+char HeaderComplement(const Header *header)
 /*---------------------------------------------------------------------------------
     Calculate Header complement check
 ---------------------------------------------------------------------------------*/
 {
     int n;
     char c = 0;
-    char *p = (char *)&header + 0xA0;
+    const char *p = (const char *)header + 0xA0;
     for (n=0; n<0xBD-0xA0; n++)
     {
         c += *p++;
@@ -131,23 +143,762 @@ char HeaderComplement()
 }
 
 
+//---------------------------------------------------------------------------------
+// RomFile
+//---------------------------------------------------------------------------------
+/*
+    A ROM or ELF mapped into memory, so that the header is fixed in place and
+    padding is added without copying the rest of the file. Where mmap isn't
+    available the file is read in and written back.
+*/
+typedef struct
+{
+    const char *path;
+    uint8_t    *data;
+    size_t      size;
+    int         writable;
+#ifndef _WIN32
+    int         fd;
+#endif
+} RomFile;
+
+//---------------------------------------------------------------------------------
+int MapRom(RomFile *rom, const char *path, int writable)
+//---------------------------------------------------------------------------------
+{
+    rom->path = path;
+    rom->data = NULL;
+    rom->size = 0;
+    rom->writable = writable;
+
+#ifdef _WIN32
+    FILE *fp = fopen(path, "rb");
+    long size;
+
+    if (!fp) return 0;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    if (size < 0) { fclose(fp); return 0; }
+
+    rom->size = size;
+    rom->data = malloc(rom->size ? rom->size : 1);
+    if (!rom->data || fread(rom->data, 1, rom->size, fp) != rom->size) { fclose(fp); free(rom->data); return 0; }
+    fclose(fp);
+#else
+    struct stat st;
+
+    rom->fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (rom->fd < 0) return 0;
+    if (fstat(rom->fd, &st) != 0) { close(rom->fd); return 0; }
+
+    rom->size = st.st_size;
+    if (rom->size)
+    {
+        void *data = mmap(NULL, rom->size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, rom->fd, 0);
+        if (data == MAP_FAILED) { close(rom->fd); return 0; }
+        rom->data = data;
+    }
+#endif
+
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_READ, rom->size);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------
+int CreateRom(RomFile *rom, const char *path, size_t size)
+/*---------------------------------------------------------------------------------
+    Create or truncate a file of size zero bytes and map it for writing
+---------------------------------------------------------------------------------*/
+{
+    rom->path = path;
+    rom->data = NULL;
+    rom->size = size;
+    rom->writable = 1;
+
+#ifdef _WIN32
+    rom->data = calloc(size, 1);
+    if (!rom->data) return 0;
+#else
+    void *data;
+
+    rom->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (rom->fd < 0) return 0;
+    if (ftruncate(rom->fd, size) != 0) { close(rom->fd); return 0; }
+
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rom->fd, 0);
+    if (data == MAP_FAILED) { close(rom->fd); return 0; }
+    rom->data = data;
+#endif
+
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------
+int GrowRom(RomFile *rom, size_t size)
+/*---------------------------------------------------------------------------------
+    Extend the file to size bytes, filling the new space with 0xFF
+---------------------------------------------------------------------------------*/
+{
+    uint8_t *data;
+
+#ifdef _WIN32
+    data = realloc(rom->data, size);
+    if (!data) return 0;
+#else
+    if (rom->size) munmap(rom->data, rom->size);
+    rom->data = NULL;
+    if (ftruncate(rom->fd, size) != 0) { rom->size = 0; return 0; }
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rom->fd, 0);
+    if (data == MAP_FAILED) { rom->size = 0; return 0; }
+#endif
+
+    memset(data + rom->size, 0xFF, size - rom->size);
+    rom->data = data;
+    rom->size = size;
+    return 1;
+}
+
+//---------------------------------------------------------------------------------
+int UnmapRom(RomFile *rom)
+//---------------------------------------------------------------------------------
+{
+    int ok = 1;
+
+#ifdef _WIN32
+    if (rom->writable)
+    {
+        FILE *fp = fopen(rom->path, "wb");
+        if (!fp || fwrite(rom->data, 1, rom->size, fp) != rom->size) ok = 0;
+        if (fp && fclose(fp) != 0) ok = 0;
+    }
+    free(rom->data);
+#else
+    if (rom->size) munmap(rom->data, rom->size);
+    if (close(rom->fd) != 0) ok = 0;
+#endif
+
+    if (rom->writable) PROFILE_COUNT(PROFILE_BYTES_WRITTEN, rom->size);
+
+    rom->data = NULL;
+    return ok;
+}
+
+//---------------------------------------------------------------------------------
+int FindElfHeader(const RomFile *rom, uint32_t *offset)
+/*---------------------------------------------------------------------------------
+    Find the file offset of the PROGBITS section at the ELF's entry point
+---------------------------------------------------------------------------------*/
+{
+    Elf32_Ehdr elfHeader;
+    Elf32_Shdr secHeader;
+    int i;
+
+    if (rom->size < sizeof(elfHeader)) return 0;
+    memcpy(&elfHeader, rom->data, sizeof(elfHeader));
+
+    if (elfHeader.e_shoff > rom->size || (size_t)elfHeader.e_shnum * sizeof(secHeader) > rom->size - elfHeader.e_shoff)
+        return 0;
+
+    for (i = 0; i < elfHeader.e_shnum; i++)
+    {
+        memcpy(&secHeader, rom->data + elfHeader.e_shoff + i * sizeof(secHeader), sizeof(secHeader));
+        if (secHeader.sh_type == SHT_PROGBITS && secHeader.sh_addr == elfHeader.e_entry)
+        {
+            *offset = secHeader.sh_offset;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+//---------------------------------------------------------------------------------
+const char *WriteRomFromElf(RomFile *rom, const char *elffile, const char *romfile)
+/*---------------------------------------------------------------------------------
+    Write the flat image of an ELF to romfile the way objcopy -O binary does,
+    and leave it mapped in rom. Returns an error message, or NULL on success.
+---------------------------------------------------------------------------------*/
+{
+    RomFile elf;
+    ElfImage image;
+    const char *error;
+    long long profileStart = ProfileBegin();
+
+    if (!MapRom(&elf, elffile, 0)) return "Error opening ELF file!";
+
+    error = GetElfImage(&image, elf.data, elf.size);
+    if (!error && !CreateRom(rom, romfile, image.size)) error = "Error opening output file!";
+    if (!error) CopyElfImage(&image, rom->data);
+
+    UnmapRom(&elf);
+    ProfileEnd("WriteRomFromElf", elffile, profileStart);
+    return error;
+}
+
+//---------------------------------------------------------------------------------
+int WriteLz(const char *path, const uint8_t *data, size_t size, int minDistance)
+/*---------------------------------------------------------------------------------
+    Write an LZ77-compressed copy of the ROM, as gbagfx does
+---------------------------------------------------------------------------------*/
+{
+    unsigned char *compressed;
+    int compressedSize;
+    FILE *fp;
+    int ok;
+
+    if (size == 0 || size >= (1 << 24)) return 0;
+
+    compressed = LZCompress((unsigned char *)data, (int)size, &compressedSize, minDistance);
+    fp = fopen(path, "wb");
+    ok = fp && fwrite(compressed, 1, compressedSize, fp) == (size_t)compressedSize;
+    if (fp && fclose(fp) != 0) ok = 0;
+    free(compressed);
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_WRITTEN, compressedSize);
+    return ok;
+}
+
+//---------------------------------------------------------------------------------
+const char *BaseName(const char *path)
+//---------------------------------------------------------------------------------
+{
+    const char *t;
+    t = strrchr(path, '/'); if (t) path = t+1;
+    t = strrchr(path, '\\'); if (t) path = t+1;
+    return path;
+}
+
+//---------------------------------------------------------------------------------
+int ReadSha1Line(FILE *fp, char hash[41], char *name, size_t nameSize)
+/*---------------------------------------------------------------------------------
+    Read the next "<sha1>  <file>" line of a sha1sum list
+---------------------------------------------------------------------------------*/
+{
+    char line[1024];
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        size_t length = strcspn(line, "\r\n");
+        char *file = line + 40;
+
+        line[length] = 0;
+        if (length < 42 || strspn(line, "0123456789abcdefABCDEF") != 40 || *file != ' ') continue;
+
+        file++;
+        if (*file == ' ' || *file == '*') file++;
+
+        for (length = 0; length < 40; length++)
+            hash[length] = (line[length] >= 'A' && line[length] <= 'F') ? line[length] - 'A' + 'a' : line[length];
+        hash[40] = 0;
+        strncpy(name, file, nameSize - 1);
+        name[nameSize - 1] = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+//---------------------------------------------------------------------------------
+int CheckSha1(const char *name, const char *expected, const RomDigest *digest, int silent)
+//---------------------------------------------------------------------------------
+{
+    char actual[41];
+
+    FormatSha1(digest->sha1, actual);
+
+    if (strcmp(actual, expected) != 0)
+    {
+        printf("%s: FAILED\n", name);
+        return 0;
+    }
+
+    if (!silent) printf("%s: OK\n", name);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------
+int VerifyList(const char *listfile, int silent)
+/*---------------------------------------------------------------------------------
+    Check every file in a sha1sum list, like sha1sum -c
+---------------------------------------------------------------------------------*/
+{
+    char hash[41], name[512];
+    int failed = 0, count = 0;
+    FILE *fp = fopen(listfile, "r");
+
+    if (!fp) { fprintf(stderr, "Error opening %s!\n", listfile); return -1; }
+
+    while (ReadSha1Line(fp, hash, name, sizeof(name)))
+    {
+        RomFile rom;
+        RomDigest digest;
+
+        count++;
+        if (!MapRom(&rom, name, 0))
+        {
+            printf("%s: FAILED open or read\n", name);
+            failed++;
+            continue;
+        }
+
+        DigestRom(rom.data, rom.size, &digest);
+        UnmapRom(&rom);
+        if (!CheckSha1(name, hash, &digest, silent)) failed++;
+    }
+
+    fclose(fp);
+
+    if (count == 0) { fprintf(stderr, "%s: no properly formatted SHA1 checksum lines found\n", listfile); return -1; }
+    if (failed) { fprintf(stderr, "WARNING: %d of %d computed checksums did NOT match\n", failed, count); return 1; }
+    return 0;
+}
+
+//---------------------------------------------------------------------------------
+int VerifyRom(const char *listfile, const char *romfile, const RomDigest *digest)
+/*---------------------------------------------------------------------------------
+    Check a ROM against its entry in a sha1sum list, matched by path or file name.
+    Returns 1 if it matches, 0 if not, -1 if there's no entry and -2 if the
+    list can't be read.
+---------------------------------------------------------------------------------*/
+{
+    char hash[41], name[512], actual[41];
+    FILE *fp = fopen(listfile, "r");
+
+    if (!fp) return -2;
+
+    while (ReadSha1Line(fp, hash, name, sizeof(name)))
+    {
+        if (strcmp(name, romfile) == 0 || strcmp(BaseName(name), BaseName(romfile)) == 0)
+        {
+            fclose(fp);
+            FormatSha1(digest->sha1, actual);
+            return strcmp(actual, hash) == 0;
+        }
+    }
+
+    fclose(fp);
+    return -1;
+}
+
+//---------------------------------------------------------------------------------
+// Fixing
+//---------------------------------------------------------------------------------
+typedef struct
+{
+    int         pad;
+    int         silent;
+    int         checksums;
+    const char *verifyfile;
+    const char *elffile;        // write the ROM from this ELF first
+    int         keep_header;
+    const char *lzfile;         // also write an LZ-compressed copy here
+    int         lz_search;
+    const char *title;          // -t argument, "" for the file name
+    const char *game_code;
+    const char *maker_code;
+    int         set_version;
+    uint8_t     version;
+    int         set_debug;
+    uint8_t     debug;
+} FixOptions;
+
+typedef struct
+{
+    int         status;         // what main returns for this file
+    const char *error;
+    const char *warning;
+    char        title[256];     // title taken from the file name, if any
+    size_t      size;
+    int         verified;       // 1 matched, 0 didn't, -1 not checked
+    int         have_digest;
+    RomDigest   digest;
+} FixResult;
+
+//---------------------------------------------------------------------------------
+int ParseArg(const char *arg, FixOptions *opts, const char **argfile)
+/*---------------------------------------------------------------------------------
+    Returns 0 if the argument was understood, 1 if it's an invalid option and
+    2 if it needs a value
+---------------------------------------------------------------------------------*/
+{
+    const char *value = arg + 2;
+
+    if (arg[0] != '-') { *argfile = arg; return 0; }
+
+    switch (arg[1])
+    {
+        case 'p': opts->pad = 1; return 0;
+        case 't': opts->title = value; return 0;
+        case 'c': opts->game_code = value; return 0;
+        case 'm': opts->maker_code = value; return 0;
+        case 'v': return 0;     // ignored, compatability with other gbafix
+        case 'r':
+            if (!value[0]) return 2;
+            opts->set_version = 1;
+            opts->version = (unsigned char)strtoul(value, NULL, 0);
+            return 0;
+        case 'd':
+            if (!value[0]) return 2;
+            opts->set_debug = 1;
+            opts->debug = (unsigned char)((strtoul(value, NULL, 0) & 1) << 7);
+            return 0;
+        case '-':
+            if (strncmp("--silent", arg, 7) == 0) opts->silent = 1;
+            else if (strcmp("--checksums", arg) == 0) opts->checksums = 1;
+            else if (strcmp("--verify", arg) == 0) opts->verifyfile = "rom.sha1";
+            else if (strncmp("--verify=", arg, 9) == 0) opts->verifyfile = arg + 9;
+            else if (strncmp("--elf=", arg, 6) == 0) opts->elffile = arg + 6;
+            else if (strcmp("--keep-header", arg) == 0) opts->keep_header = 1;
+            else if (strncmp("--lz=", arg, 5) == 0) opts->lzfile = arg + 5;
+            else if (strncmp("--lz-search=", arg, 12) == 0)
+            {
+                if (!arg[12]) return 2;
+                opts->lz_search = (int)strtoul(arg + 12, NULL, 0);
+            }
+            return 0;
+    }
+
+    return 1;
+}
+
+//---------------------------------------------------------------------------------
+void FixHeader(Header *header, const char *argfile, const FixOptions *opts, FixResult *result)
+//---------------------------------------------------------------------------------
+{
+    // fix some data
+    memcpy(header->logo, good_header.logo, sizeof(header->logo));
+    memcpy(&header->fixed, &good_header.fixed, sizeof(header->fixed));
+    memcpy(&header->device_type, &good_header.device_type, sizeof(header->device_type));
+
+    if (opts->title)
+    {
+        char title[256];
+        memset(title, 0, sizeof(title));
+        if (opts->title[0])
+        {
+            strncpy(title, opts->title, sizeof(header->title));
+        }
+        else
+        {
+            // use filename
+            char *t;
+            strncpy(result->title, BaseName(argfile), sizeof(result->title) - 1);
+            t = strrchr(result->title, '.'); if (t) *t = 0;
+            strncpy(title, result->title, sizeof(header->title));
+        }
+        memcpy(header->title, title, sizeof(header->title));    // copy
+    }
+
+    if (opts->game_code)
+    {
+        const char *v = opts->game_code;
+        header->game_code = v[0] | v[1]<<8 | v[2]<<16 | v[3]<<24;
+    }
+
+    if (opts->maker_code)
+    {
+        const char *v = opts->maker_code;
+        header->maker_code = v[0] | v[1]<<8;
+    }
+
+    if (opts->set_version) header->game_version = opts->version;
+
+    if (opts->set_debug)
+    {
+        header->logo[0x9C-0x04] = 0xA5;    // debug enable
+        header->device_type = opts->debug;    // debug handler entry point
+    }
+
+    // update complement check & total checksum
+    header->complement = 0;
+    header->checksum = 0;    // must be 0
+    header->complement = HeaderComplement(header);
+    //header->checksum = checksum_without_header + HeaderChecksum();
+}
+
+//---------------------------------------------------------------------------------
+void FixRom(const char *argfile, const FixOptions *opts, FixResult *result)
+//---------------------------------------------------------------------------------
+{
+    RomFile rom;
+    Header header;
+    uint32_t sh_offset = 0;
+
+    memset(result, 0, sizeof(*result));
+    result->verified = -1;
+
+    // map file, writing it from the ELF first if there is one
+    if (opts->elffile)
+    {
+        result->error = WriteRomFromElf(&rom, opts->elffile, argfile);
+        if (result->error) { result->status = -1; return; }
+    }
+    else if (!MapRom(&rom, argfile, 1))
+    {
+        result->error = "Error opening input file!";
+        result->status = -1;
+        return;
+    }
+
+    if (!opts->keep_header)
+    {
+        // elf check
+        if (!opts->elffile && rom.size >= 4 && memcmp(rom.data, ELFMAG, 4) == 0) {
+            if (!FindElfHeader(&rom, &sh_offset)) { UnmapRom(&rom); result->error = "Error finding entry point!"; result->status = 1; return; }
+        }
+        if (sh_offset > rom.size || rom.size - sh_offset < sizeof(header)) { UnmapRom(&rom); result->error = "Error: input file is too small!"; result->status = -1; return; }
+        memcpy(&header, rom.data + sh_offset, sizeof(header));
+
+        FixHeader(&header, argfile, opts, result);
+    }
+
+    if (opts->pad) {
+        if (sh_offset != 0) {
+            result->warning = "Warning: Cannot safely pad an ELF";
+        } else {
+            size_t size = 1;
+            while (size < rom.size) size <<= 1;
+            if (size != rom.size && !GrowRom(&rom, size)) { UnmapRom(&rom); result->error = "Error padding ROM!"; result->status = -1; return; }
+        }
+    }
+
+    if (!opts->keep_header) memcpy(rom.data + sh_offset, &header, sizeof(header));
+    result->size = rom.size;
+
+    if (opts->checksums || opts->verifyfile)
+    {
+        long long profileStart = ProfileBegin();
+        DigestRom(rom.data, rom.size, &result->digest);
+        ProfileEnd("DigestRom", argfile, profileStart);
+        result->have_digest = 1;
+
+        if (opts->verifyfile)
+        {
+            result->verified = VerifyRom(opts->verifyfile, argfile, &result->digest);
+            if (result->verified == -2) result->error = "Error opening SHA-1 list!";
+            if (result->verified == -1) result->error = "Error: SHA-1 list has no entry for the ROM!";
+            if (result->verified < 0) { result->verified = -1; result->status = -1; }
+            else if (!result->verified) result->status = 1;
+        }
+    }
+
+    if (opts->lzfile && !WriteLz(opts->lzfile, rom.data, rom.size, opts->lz_search ? opts->lz_search : 2))
+    {
+        result->error = "Error writing LZ file!";
+        result->status = -1;
+    }
+
+    if (!UnmapRom(&rom)) { result->error = "Error writing output file!"; result->status = -1; }
+}
+
+//---------------------------------------------------------------------------------
+// Batch mode
+//---------------------------------------------------------------------------------
+/*
+    Each line of the list is a ROM or ELF followed by its own options, which
+    come after the ones given on the command line. The files are fixed on a
+    pool of threads and the results are printed as JSON.
+*/
+typedef struct
+{
+    char       *line;
+    const char *file;
+    FixOptions  opts;
+    FixResult   result;
+} BatchJob;
+
+typedef struct
+{
+    BatchJob   *jobs;
+    int         count;
+    int         next;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+} BatchQueue;
+
+//---------------------------------------------------------------------------------
+void *BatchWorker(void *arg)
+//---------------------------------------------------------------------------------
+{
+    BatchQueue *queue = arg;
+
+    for (;;)
+    {
+        int i;
+
+#ifndef _WIN32
+        pthread_mutex_lock(&queue->lock);
+#endif
+        i = queue->next++;
+#ifndef _WIN32
+        pthread_mutex_unlock(&queue->lock);
+#endif
+
+        if (i >= queue->count) return NULL;
+
+        long long profileStart = ProfileBegin();
+        FixRom(queue->jobs[i].file, &queue->jobs[i].opts, &queue->jobs[i].result);
+        ProfileEnd("FixRom", queue->jobs[i].file, profileStart);
+    }
+}
+
+//---------------------------------------------------------------------------------
+void PrintJsonString(const char *s)
+//---------------------------------------------------------------------------------
+{
+    putchar('"');
+    for (; *s; s++)
+    {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') printf("\\%c", c);
+        else if (c < 0x20) printf("\\u%04x", c);
+        else putchar(c);
+    }
+    putchar('"');
+}
+
+//---------------------------------------------------------------------------------
+void PrintJsonResult(const BatchJob *job, int last)
+//---------------------------------------------------------------------------------
+{
+    const FixResult *r = &job->result;
+
+    printf("  {\"file\": ");
+    PrintJsonString(job->file);
+    printf(", \"ok\": %s", r->status == 0 ? "true" : "false");
+
+    if (r->error) { printf(", \"error\": "); PrintJsonString(r->error); }
+    if (r->warning) { printf(", \"warning\": "); PrintJsonString(r->warning); }
+
+    if (r->size) printf(", \"size\": %lu", (unsigned long)r->size);
+
+    if (r->have_digest)
+    {
+        char sha1[41];
+        FormatSha1(r->digest.sha1, sha1);
+        printf(", \"sum\": \"%08x\", \"crc32\": \"%08x\", \"sha1\": \"%s\"", r->digest.sum, r->digest.crc32, sha1);
+    }
+
+    if (r->verified >= 0) printf(", \"verified\": %s", r->verified ? "true" : "false");
+
+    printf("}%s\n", last ? "" : ",");
+}
+
+//---------------------------------------------------------------------------------
+int RunBatch(const char *listfile, const FixOptions *defaults, int threads)
+//---------------------------------------------------------------------------------
+{
+    BatchQueue queue;
+    char line[1024];
+    int capacity = 16, lineNum = 0, failed = 0, i;
+    FILE *fp = fopen(listfile, "r");
+
+    if (!fp) { fprintf(stderr, "Error opening %s!\n", listfile); return -1; }
+
+    queue.jobs = malloc(capacity * sizeof(BatchJob));
+    queue.count = 0;
+    queue.next = 0;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        BatchJob *job;
+        char *token = line + strspn(line, " \t\r\n");
+
+        lineNum++;
+        if (!*token || *token == '#') continue;
+
+        if (queue.count == capacity)
+        {
+            capacity *= 2;
+            queue.jobs = realloc(queue.jobs, capacity * sizeof(BatchJob));
+        }
+
+        // Keep the line, since the options point into it.
+        job = &queue.jobs[queue.count];
+        job->line = malloc(sizeof(line));
+        memcpy(job->line, line, sizeof(line));
+        job->file = NULL;
+        job->opts = *defaults;
+
+        for (token = strtok(job->line, " \t\r\n"); token; token = strtok(NULL, " \t\r\n"))
+        {
+            switch (ParseArg(token, &job->opts, &job->file))
+            {
+                case 1: fprintf(stderr, "%s:%d: Invalid option: %s\n", listfile, lineNum, token); fclose(fp); return -1;
+                case 2: fprintf(stderr, "%s:%d: Need value for %s\n", listfile, lineNum, token); fclose(fp); return -1;
+            }
+        }
+
+        if (!job->file) { fprintf(stderr, "%s:%d: Filename needed!\n", listfile, lineNum); fclose(fp); return -1; }
+
+        queue.count++;
+    }
+
+    fclose(fp);
+
+    if (threads < 1) threads = 1;
+    if (threads > queue.count) threads = queue.count;
+
+#ifdef _WIN32
+    BatchWorker(&queue);
+#else
+    {
+        pthread_t *workers = malloc(threads * sizeof(pthread_t));
+        int started = 0;
+
+        pthread_mutex_init(&queue.lock, NULL);
+
+        for (i = 1; i < threads; i++)
+            if (pthread_create(&workers[started], NULL, BatchWorker, &queue) == 0) started++;
+
+        BatchWorker(&queue);
+
+        for (i = 0; i < started; i++)
+            pthread_join(workers[i], NULL);
+
+        pthread_mutex_destroy(&queue.lock);
+        free(workers);
+    }
+#endif
+
+    printf("[\n");
+    for (i = 0; i < queue.count; i++)
+    {
+        PrintJsonResult(&queue.jobs[i], i == queue.count - 1);
+        if (queue.jobs[i].result.status != 0) failed = 1;
+        free(queue.jobs[i].line);
+    }
+    printf("]\n");
+
+    free(queue.jobs);
+    return failed;
+}
+
 //---------------------------------------------------------------------------------
 int main(int argc, char *argv[])
 //---------------------------------------------------------------------------------
 {
     int arg;
-    char *argfile = 0;
-    FILE *infile;
-    int silent = 0;
-    int schedule_pad = 0;
+    const char *argfile = 0;
+    const char *batchfile = 0;
+    int threads = 1;
+    FixOptions opts;
+    FixResult result;
 
-    int size,bit;
+    ProfileInit("gbafix", &argc, argv);
 
     // show syntax
     if (argc <= 1)
     {
         printf("GBA ROM fixer v"VER" by Dark Fader / BlackThunder / WinterMute / Sierraffinity \n");
         printf("Syntax: gbafix <rom.gba> [-p] [-t[title]] [-c<game_code>] [-m<maker_code>] [-r<version>] [-d<debug>] [--silent]\n");
+        printf("               [--checksums] [--verify[=<rom.sha1>]] [--elf=<rom.elf>] [--keep-header] [--lz=<rom.lz>]\n");
+        printf("        gbafix --verify[=<rom.sha1>] [--silent]\n");
+        printf("        gbafix --batch=<list> [-j<jobs>] [options for every file]\n");
         printf("\n");
         printf("parameters:\n");
         printf("    -p              Pad to next exact power of 2. No minimum size!\n");
@@ -157,161 +908,78 @@ int main(int argc, char *argv[])
         printf("    -r<version>     Patch game version (number)\n");
         printf("    -d<debug>       Enable debugging handler and set debug entry point (0 or 1)\n");
         printf("    --silent           Silence non-error output\n");
+        printf("    --checksums        Print the byte sum, CRC-32 and SHA-1 of the fixed ROM\n");
+        printf("    --verify[=<file>]  Check the fixed ROM against its entry in a sha1sum list (rom.sha1).\n");
+        printf("                       Without a ROM, check every file in the list.\n");
+        printf("    --elf=<file>       Write the ROM from an ELF's loadable sections first, instead of objcopy\n");
+        printf("    --keep-header      Leave the header alone, for images that aren't cartridge ROMs\n");
+        printf("    --lz=<file>        Also write an LZ77-compressed copy of the ROM\n");
+        printf("    --lz-search=<n>    Minimum LZ77 match distance (default 2)\n");
+        printf("    --batch=<list>     Fix every ROM or ELF in list, one per line followed by its own options,\n");
+        printf("                       and print the results as JSON\n");
+        printf("    -j<jobs>           Number of files to fix at once in batch mode\n");
         return -1;
     }
 
-    // get filename
+    memset(&opts, 0, sizeof(opts));
+#ifndef _WIN32
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    // parse command line
     for (arg=1; arg<argc; arg++)
     {
-        if (ARGV[0] != '-') { argfile=ARGV; }
-        if (strncmp("--silent", &ARGV[0], 7) == 0) { silent = 1; }
+        if (strncmp("--batch=", ARGV, 8) == 0) { batchfile = &ARGV[8]; continue; }
+        if (strncmp("-j", ARGV, 2) == 0 && VALUE[0]) { threads = (int)NUMBER; continue; }
+
+        switch (ParseArg(ARGV, &opts, &argfile))
+        {
+            case 1: printf("Invalid option: %s\n", ARGV); break;
+            case 2: fprintf(stderr, "Need value for %s\n", ARGV); break;
+        }
+    }
+
+    if (batchfile)
+    {
+        if (argfile) { fprintf(stderr, "Files to fix in batch mode go in the list!\n"); return -1; }
+        return RunBatch(batchfile, &opts, threads);
     }
 
     // check filename
+    if (!argfile && opts.verifyfile)
+    {
+        return VerifyList(opts.verifyfile, opts.silent);
+    }
     if (!argfile)
     {
         fprintf(stderr, "Filename needed!\n");
         return -1;
     }
 
-    uint32_t sh_offset = 0;
+    long long profileStart = ProfileBegin();
+    FixRom(argfile, &opts, &result);
+    ProfileEnd("FixRom", argfile, profileStart);
 
-    // read file
-    infile = fopen(argfile, "r+b");
-    if (!infile) { fprintf(stderr, "Error opening input file!\n"); return -1; }
-    fseek(infile, sh_offset, SEEK_SET);
-    fread(&header, sizeof(header), 1, infile);
+    if (result.title[0] && !opts.silent) printf("%s\n", result.title);
+    if (result.warning) fprintf(stderr, "%s\n", result.warning);
 
-    // elf check
-    Elf32_Shdr secHeader;
-    if (memcmp(&header, ELFMAG, 4) == 0) {
-        Elf32_Ehdr *elfHeader = (Elf32_Ehdr *)&header;
-        fseek(infile, elfHeader->e_shoff, SEEK_SET);
-        int i;
-        for (i = 0; i < elfHeader->e_shnum; i++) {
-            fread(&secHeader, sizeof(Elf32_Shdr), 1, infile);
-            if (secHeader.sh_type == SHT_PROGBITS && secHeader.sh_addr == elfHeader->e_entry) break;
-        }
-        if (i == elfHeader->e_shnum) { fprintf(stderr, "Error finding entry point!\n"); return 1; }
-        fseek(infile, secHeader.sh_offset, SEEK_SET);
-        sh_offset = secHeader.sh_offset;
-        fread(&header, sizeof(header), 1, infile);
-    }
-
-    // fix some data
-    memcpy(header.logo, good_header.logo, sizeof(header.logo));
-    memcpy(&header.fixed, &good_header.fixed, sizeof(header.fixed));
-    memcpy(&header.device_type, &good_header.device_type, sizeof(header.device_type));
-
-    // parse command line
-    for (arg=1; arg<argc; arg++)
+    if (opts.checksums && result.have_digest)
     {
-        if (ARGV[0] == '-')
-        {
-            switch (ARGV[1])
-            {
-                case 'p':    // pad
-                {
-                    schedule_pad = 1;
-                    break;
-                }
-
-                case 't':    // title
-                {
-                    char title[256];
-                    memset(title, 0, sizeof(title));
-                    if (VALUE[0])
-                    {
-                        strncpy(title, VALUE, sizeof(header.title));
-                    }
-                    else
-                    {
-                        // use filename
-                        char s[256], *begin=s, *t; strcpy(s, argfile);
-                        t = strrchr(s, '\\'); if (t) begin = t+1;
-                        t = strrchr(s, '/'); if (t) begin = t+1;
-                        t = strrchr(s, '.'); if (t) *t = 0;
-                        strncpy(title, begin, sizeof(header.title));
-                        if (!silent) printf("%s\n",begin);
-                    }
-                    memcpy(header.title, title, sizeof(header.title));    // copy
-                    break;
-                }
-
-                case 'c':    // game code
-                {
-                    //if (!VALUE[0]) { fprintf(stderr, "Need value for %s\n", ARGV); break; }
-                    //header.game_code = NUMBER;
-                    header.game_code = VALUE[0] | VALUE[1]<<8 | VALUE[2]<<16 | VALUE[3]<<24;
-                    break;
-                }
-
-                case 'm':    // maker code
-                {
-                    //if (!VALUE[0]) { fprintf(stderr, "Need value for %s\n", ARGV); break; }
-                    //header.maker_code = (unsigned short)NUMBER;
-                    header.maker_code = VALUE[0] | VALUE[1]<<8;
-                    break;
-                }
-
-                case 'v':    // ignored, compatability with other gbafix
-                {
-                    break;
-                }
-
-                case 'r':    // version
-                {
-                    if (!VALUE[0]) { fprintf(stderr, "Need value for %s\n", ARGV); break; }
-                    header.game_version = (unsigned char)NUMBER;
-                    break;
-                }
-
-                case 'd':    // debug
-                {
-                    if (!VALUE[0]) { fprintf(stderr, "Need value for %s\n", ARGV); break; }
-                    header.logo[0x9C-0x04] = 0xA5;    // debug enable
-                    header.device_type = (unsigned char)((NUMBER & 1) << 7);    // debug handler entry point
-                    break;
-                }
-                case '-':    // long arguments
-                {
-                    if (strncmp("silent", &ARGV[2], 6) == 0) { continue; }
-                    break;
-                }
-            default:
-                {
-                    printf("Invalid option: %s\n", ARGV);
-                }
-            }
-        }
+        char sha1[41];
+        FormatSha1(result.digest.sha1, sha1);
+        printf("%s: size 0x%lX, sum 0x%08X, crc32 %08X, sha1 %s\n", argfile, (unsigned long)result.size, result.digest.sum, result.digest.crc32, sha1);
     }
 
-    // update complement check & total checksum
-    header.complement = 0;
-    header.checksum = 0;    // must be 0
-    header.complement = HeaderComplement();
-    //header.checksum = checksum_without_header + HeaderChecksum();
+    if (result.verified == 0) printf("%s: FAILED\n", argfile);
+    if (result.verified == 1 && !opts.silent) printf("%s: OK\n", argfile);
 
-    if (schedule_pad) {
-        if (sh_offset != 0) {
-            fprintf(stderr, "Warning: Cannot safely pad an ELF\n");
-        } else {
-            fseek(infile, 0, SEEK_END);
-            size = ftell(infile);
-            for (bit=31; bit>=0; bit--) if (size & (1<<bit)) break;
-            if (size != (1<<bit))
-            {
-                int todo = (1<<(bit+1)) - size;
-                while (todo--) fputc(0xFF, infile);
-            }
-        }
+    if (result.error)
+    {
+        fprintf(stderr, "%s\n", result.error);
+        return result.status;
     }
 
-    fseek(infile, sh_offset, SEEK_SET);
-    fwrite(&header, sizeof(header), 1, infile);
-    fclose(infile);
+    if (!opts.silent) printf("ROM fixed!\n");
 
-    if (!silent) printf("ROM fixed!\n");
-
-    return 0;
+    return result.status;
 }
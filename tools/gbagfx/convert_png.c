@@ -6,6 +6,7 @@
 #include "global.h"
 #include "convert_png.h"
 #include "gfx.h"
+#include "profile.h"
 
 static FILE *PngReadOpen(char *path, png_structp *pngStruct, png_infop *pngInfo)
 {
@@ -81,6 +82,7 @@ static unsigned char *ConvertBitDepth(unsigned char *src, int srcBitDepth, int d
 
 void ReadPng(char *path, struct Image *image)
 {
+    long long profileStart = ProfileBegin();
     png_structp png_ptr;
     png_infop info_ptr;
 
@@ -123,6 +125,9 @@ void ReadPng(char *path, struct Image *image)
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
     free(row_pointers);
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_READ, ftell(fp));
+    PROFILE_COUNT(PROFILE_ALLOCATIONS, 2);
     fclose(fp);
 
     if (bit_depth != image->bitDepth && image->tilemap.data.affine == NULL)
@@ -135,6 +140,8 @@ void ReadPng(char *path, struct Image *image)
         free(src);
         image->bitDepth = bit_depth;
     }
+
+    ProfileEnd("ReadPng", path, profileStart);
 }
 
 void ReadPngPalette(char *path, struct Palette *palette)
@@ -187,6 +194,7 @@ void SetPngPalette(png_structp png_ptr, png_infop info_ptr, struct Palette *pale
 
 void WritePng(char *path, struct Image *image)
 {
+    long long profileStart = ProfileBegin();
     FILE *fp = fopen(path, "wb");
 
     if (fp == NULL)
@@ -247,8 +255,13 @@ void WritePng(char *path, struct Image *image)
 
     png_write_end(png_ptr, NULL);
 
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_WRITTEN, ftell(fp));
+    PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
     fclose(fp);
 
     png_destroy_write_struct(&png_ptr, &info_ptr);
     free(row_pointers);
+
+    ProfileEnd("WritePng", path, profileStart);
 }
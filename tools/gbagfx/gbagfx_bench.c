@@ -0,0 +1,501 @@
+// Copyright (c) 2015 YamaArashi
+
+// Times the compressors and the image conversions over a fixed corpus and checks that
+// everything round-trips. Run with "make bench".
+// The real assets are passed on the command line: .png files go through the tile and PNG
+// paths and their 4bpp tiles are compressed; any other file is compressed as is.
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "global.h"
+#include "gfx.h"
+#include "convert_png.h"
+#include "util.h"
+#include "lz.h"
+#include "rl.h"
+#include "huff.h"
+
+#define SYNTHETIC_SIZE 0x10000
+#define MIN_SECONDS 0.25
+#define TILES_PATH "gbagfx_bench.4bpp"
+#define PNG_PATH "gbagfx_bench.png"
+
+struct Codec
+{
+    const char *name;
+    unsigned char *(*compress)(unsigned char *src, int srcSize, int *compressedSize);
+    unsigned char *(*decompress)(unsigned char *src, int srcSize, int *uncompressedSize);
+    int huffBitDepth;
+};
+
+static unsigned char *CompressLz(unsigned char *src, int srcSize, int *compressedSize)
+{
+    return LZCompress(src, srcSize, compressedSize, 2);
+}
+
+static unsigned char *CompressLzOptimal(unsigned char *src, int srcSize, int *compressedSize)
+{
+    return LZCompressOptimal(src, srcSize, compressedSize, 2);
+}
+
+static unsigned char *CompressHuff4(unsigned char *src, int srcSize, int *compressedSize)
+{
+    return HuffCompress(src, srcSize, compressedSize, 4);
+}
+
+static unsigned char *CompressHuff8(unsigned char *src, int srcSize, int *compressedSize)
+{
+    return HuffCompress(src, srcSize, compressedSize, 8);
+}
+
+static const struct Codec s_codecs[] =
+{
+    { "lz", CompressLz, LZDecompress, 0 },
+    { "lz -optimal", CompressLzOptimal, LZDecompress, 0 },
+    { "rl", RLCompress, RLDecompress, 0 },
+    { "huff4", CompressHuff4, HuffDecompress, 4 },
+    { "huff8", CompressHuff8, HuffDecompress, 8 },
+};
+
+static bool s_failed;
+
+static double GetSeconds(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Each test runs in its own process, so this is the most that test needed.
+static double GetPeakRssMegabytes(void)
+{
+#ifdef _WIN32
+    return 0.0;
+#else
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+static double GetMegabytesPerSecond(int size, double seconds)
+{
+    return size / (1024.0 * 1024.0) / seconds;
+}
+
+static unsigned int NextRandom(unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static unsigned char *MakeRandom(int size)
+{
+    unsigned char *data = malloc(size);
+    unsigned int seed = 1;
+
+    for (int i = 0; i < size; i++)
+        data[i] = NextRandom(&seed);
+
+    return data;
+}
+
+static unsigned char *MakeZeros(int size)
+{
+    return calloc(size, 1);
+}
+
+// 4bpp tiles drawn from a small set, mostly transparent with horizontal runs of one color.
+static unsigned char *MakeTiles(int size)
+{
+    unsigned char patterns[16][32];
+    unsigned char *data = malloc(size);
+    unsigned int seed = 2;
+
+    for (int i = 0; i < 16; i++)
+    {
+        for (int j = 0; j < 32; j += 4)
+        {
+            unsigned int color = (NextRandom(&seed) % 3 == 0) ? NextRandom(&seed) % 16 : 0;
+
+            memset(&patterns[i][j], color * 0x11, 4);
+        }
+    }
+
+    for (int i = 0; i < size; i += 32)
+        memcpy(data + i, patterns[NextRandom(&seed) % 16], 32);
+
+    return data;
+}
+
+static unsigned char *MakeText(int size)
+{
+    static const char *const words[] = {
+        "the ", "a ", "you ", "found ", "item ", "POTION ", "used ", "on ", "is ",
+        "it's ", "super ", "effective!\n", "wild ", "appeared!\n", "\n",
+    };
+    unsigned char *data = malloc(size);
+    unsigned int seed = 3;
+    int pos = 0;
+
+    while (pos < size)
+    {
+        const char *word = words[NextRandom(&seed) % (sizeof(words) / sizeof(words[0]))];
+
+        for (int i = 0; word[i] != 0 && pos < size; i++)
+            data[pos++] = word[i];
+    }
+
+    return data;
+}
+
+// Shortens the asset paths so the columns line up.
+static const char *GetDisplayName(const char *input)
+{
+    const char *slash = strrchr(input, '/');
+
+    return (slash != NULL) ? slash + 1 : input;
+}
+
+static void PrintRow(const char *input, const char *test, int size, int outputSize, double forwardSeconds, double backwardSeconds)
+{
+    printf("%-24s %-12s %8d %6.1f%% %10.2f %10.2f %8.1f MB\n", GetDisplayName(input), test, size, outputSize * 100.0 / size,
+        GetMegabytesPerSecond(size, forwardSeconds), GetMegabytesPerSecond(size, backwardSeconds), GetPeakRssMegabytes());
+}
+
+static void Fail(const char *input, const char *test)
+{
+    fprintf(stderr, "%s: %s output does not round-trip.\n", input, test);
+    s_failed = true;
+}
+
+// Runs a test in a child process so that the peak RSS it prints is its own and not
+// the most that any earlier test used. A failed test makes the child exit with 1.
+static void RunTest(void (*test)(void *), void *arg)
+{
+#ifdef _WIN32
+    test(arg);
+#else
+    fflush(stdout);
+
+    pid_t pid = fork();
+
+    if (pid < 0)
+        FATAL_ERROR("Failed to start a test process.\n");
+
+    if (pid == 0)
+    {
+        test(arg);
+        fflush(stdout);
+        _exit(s_failed ? 1 : 0);
+    }
+
+    int status;
+
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        s_failed = true;
+#endif
+}
+
+static int CountSymbols(unsigned char *src, int size, int bitDepth)
+{
+    bool seen[256] = {false};
+    int mask = (1 << bitDepth) - 1;
+    int count = 0;
+
+    for (int i = 0; i < size; i++)
+    {
+        for (int shift = 0; shift < 8; shift += bitDepth)
+        {
+            int symbol = (src[i] >> shift) & mask;
+
+            if (!seen[symbol])
+            {
+                seen[symbol] = true;
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+struct CodecTest
+{
+    const char *input;
+    const struct Codec *codec;
+    unsigned char *src;
+    int size;
+};
+
+static void TestCodec(void *arg)
+{
+    const struct CodecTest *test = arg;
+    const char *input = test->input;
+    const struct Codec *codec = test->codec;
+    unsigned char *src = test->src;
+    int size = test->size;
+    unsigned char *compressed = NULL;
+    unsigned char *decompressed = NULL;
+    int compressedSize = 0;
+    int decompressedSize = 0;
+    int iterations = 0;
+    double start = GetSeconds();
+    double compressSeconds;
+    double decompressSeconds;
+
+    do
+    {
+        free(compressed);
+        compressed = codec->compress(src, size, &compressedSize);
+        iterations++;
+    } while ((compressSeconds = GetSeconds() - start) < MIN_SECONDS);
+
+    compressSeconds /= iterations;
+    iterations = 0;
+    start = GetSeconds();
+
+    do
+    {
+        free(decompressed);
+        decompressed = codec->decompress(compressed, compressedSize, &decompressedSize);
+        iterations++;
+    } while ((decompressSeconds = GetSeconds() - start) < MIN_SECONDS);
+
+    decompressSeconds /= iterations;
+
+    if (decompressed == NULL || decompressedSize != size || memcmp(decompressed, src, size) != 0)
+        Fail(input, codec->name);
+
+    PrintRow(input, codec->name, size, compressedSize, compressSeconds, decompressSeconds);
+
+    free(compressed);
+    free(decompressed);
+}
+
+static void BenchCodec(const char *input, const struct Codec *codec, unsigned char *src, int size)
+{
+    if (codec->huffBitDepth != 0)
+    {
+        // HuffDecompress writes whole words.
+        if (size % 4 != 0)
+        {
+            printf("%-24s %-12s skipped, size is not a multiple of 4\n", GetDisplayName(input), codec->name);
+            return;
+        }
+
+        // HuffCompress can't build a tree from one symbol, and past 64 symbols (127 nodes)
+        // a branch's children may be too far away for the tree table to point to.
+        int numSymbols = CountSymbols(src, size, codec->huffBitDepth);
+
+        if (numSymbols < 2 || numSymbols > 64)
+        {
+            printf("%-24s %-12s skipped, input has %d symbol(s)\n", GetDisplayName(input), codec->name, numSymbols);
+            return;
+        }
+    }
+
+    struct CodecTest test = { input, codec, src, size };
+
+    RunTest(TestCodec, &test);
+}
+
+static void BenchCodecs(const char *input, unsigned char *src, int size)
+{
+    for (int i = 0; i < sizeof(s_codecs) / sizeof(s_codecs[0]); i++)
+        BenchCodec(input, &s_codecs[i], src, size);
+}
+
+static long GetFileSize(char *path)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", path);
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+
+    return size;
+}
+
+struct ImageTest
+{
+    char *path;
+    struct Image *image;
+    int size;
+    bool invertColors;
+};
+
+// PNG -> 4bpp tiles, as "gbagfx x.png x.4bpp" does it, and back.
+// The tiles are left in TILES_PATH for the other tests.
+static void TestTiles(void *arg)
+{
+    const struct ImageTest *test = arg;
+    struct Image tiles = {0};
+    int iterations = 0;
+    double start = GetSeconds();
+    double seconds;
+    double readSeconds;
+
+    do
+    {
+        WriteImage(TILES_PATH, 0, 4, 1, 1, test->image, test->invertColors);
+        iterations++;
+    } while ((seconds = GetSeconds() - start) < MIN_SECONDS);
+
+    seconds /= iterations;
+    iterations = 0;
+    start = GetSeconds();
+
+    do
+    {
+        FreeImage(&tiles);
+        ReadImage(TILES_PATH, test->image->width / 8, 4, 1, 1, &tiles, test->invertColors);
+        iterations++;
+    } while ((readSeconds = GetSeconds() - start) < MIN_SECONDS);
+
+    readSeconds /= iterations;
+
+    if (tiles.width != test->image->width || tiles.height != test->image->height
+        || memcmp(tiles.pixels, test->image->pixels, test->size) != 0)
+        Fail(test->path, "tiles");
+
+    PrintRow(test->path, "tiles", test->size, GetFileSize(TILES_PATH), seconds, readSeconds);
+
+    FreeImage(&tiles);
+}
+
+// 4bpp tiles -> PNG, as "gbagfx x.4bpp x.png" does it, and back.
+static void TestPng(void *arg)
+{
+    const struct ImageTest *test = arg;
+    struct Image tiles = {0};
+    struct Image png = {0};
+    int iterations = 0;
+    double start;
+    double seconds;
+    double readSeconds;
+
+    ReadImage(TILES_PATH, test->image->width / 8, 4, 1, 1, &tiles, test->invertColors);
+    tiles.hasPalette = test->image->hasPalette;
+    tiles.palette = test->image->palette;
+    tiles.hasTransparency = false;
+    start = GetSeconds();
+
+    do
+    {
+        WritePng(PNG_PATH, &tiles);
+        iterations++;
+    } while ((seconds = GetSeconds() - start) < MIN_SECONDS);
+
+    seconds /= iterations;
+    iterations = 0;
+    start = GetSeconds();
+
+    do
+    {
+        FreeImage(&png);
+        png.bitDepth = 4;
+        ReadPng(PNG_PATH, &png);
+        iterations++;
+    } while ((readSeconds = GetSeconds() - start) < MIN_SECONDS);
+
+    readSeconds /= iterations;
+
+    if (png.width != test->image->width || png.height != test->image->height
+        || memcmp(png.pixels, test->image->pixels, test->size) != 0)
+        Fail(test->path, "png");
+
+    PrintRow(test->path, "png", test->size, GetFileSize(PNG_PATH), seconds, readSeconds);
+
+    FreeImage(&png);
+    FreeImage(&tiles);
+}
+
+static void BenchPng(char *path)
+{
+    struct Image image = {0};
+
+    image.bitDepth = 4;
+    image.tilemap.data.affine = NULL;
+    ReadPng(path, &image);
+    image.bitDepth = 4;
+
+    if (image.hasPalette)
+        ReadPngPalette(path, &image.palette);
+
+    struct ImageTest test = { path, &image, image.width * image.height / 2, !image.hasPalette };
+
+    RunTest(TestTiles, &test);
+    RunTest(TestPng, &test);
+
+    // The codecs see the tiles as they would be in the ROM.
+    int tileSize;
+    unsigned char *tileData = ReadWholeFile(TILES_PATH, &tileSize);
+
+    BenchCodecs(path, tileData, tileSize);
+
+    free(tileData);
+    FreeImage(&image);
+    remove(TILES_PATH);
+    remove(PNG_PATH);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct
+    {
+        const char *name;
+        unsigned char *(*make)(int size);
+    } synthetic[] =
+    {
+        { "synthetic random", MakeRandom },
+        { "synthetic zeros", MakeZeros },
+        { "synthetic tiles", MakeTiles },
+        { "synthetic text", MakeText },
+    };
+
+    printf("%-24s %-12s %8s %7s %10s %10s %11s\n", "input", "test", "bytes", "ratio", "enc MB/s", "dec MB/s", "peak RSS");
+
+    for (int i = 0; i < sizeof(synthetic) / sizeof(synthetic[0]); i++)
+    {
+        unsigned char *data = synthetic[i].make(SYNTHETIC_SIZE);
+
+        BenchCodecs(synthetic[i].name, data, SYNTHETIC_SIZE);
+        free(data);
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        char *extension = GetFileExtensionAfterDot(argv[i]);
+
+        if (extension != NULL && strcmp(extension, "png") == 0)
+        {
+            BenchPng(argv[i]);
+        }
+        else
+        {
+            int size;
+            unsigned char *data = ReadWholeFile(argv[i], &size);
+
+            BenchCodecs(argv[i], data, size);
+            free(data);
+        }
+    }
+
+    return s_failed ? 1 : 0;
+}
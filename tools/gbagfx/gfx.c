@@ -8,6 +8,7 @@
 #include "global.h"
 #include "gfx.h"
 #include "util.h"
+#include "profile.h"
 
 #define GET_GBA_PAL_RED(x)   (((x) >>  0) & 0x1F)
 #define GET_GBA_PAL_GREEN(x) (((x) >>  5) & 0x1F)
@@ -347,6 +348,7 @@ static unsigned char *DecodeTilemap(unsigned char *tiles, struct Tilemap *tilema
 
 void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
 {
+	long long profileStart = ProfileBegin();
 	int tileSize = bitDepth * 8;
 
 	int fileSize;
@@ -395,10 +397,14 @@ void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int
 	}
 
 	free(buffer);
+
+	PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+	ProfileEnd("ReadImage", path, profileStart);
 }
 
 void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
 {
+	long long profileStart = ProfileBegin();
 	int tileSize = bitDepth * 8;
 
 	if (image->width % 8 != 0)
@@ -446,6 +452,9 @@ void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int m
 	WriteWholeFile(path, buffer, bufferSize);
 
 	free(buffer);
+
+	PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+	ProfileEnd("WriteImage", path, profileStart);
 }
 
 void FreeImage(struct Image *image)
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include "global.h"
 #include "huff.h"
+#include "profile.h"
 
 static int cmp_tree(const void * a0, const void * b0) {
     return ((struct HuffData *)a0)->value - ((struct HuffData *)b0)->value;
@@ -201,7 +202,7 @@ static void write_bits(unsigned char * dest, int * destPos, struct BitEncoding *
         int diff = *buffBits + nbits - 32;
         *buff <<= nbits - diff;
         *buff |= bitstring >> diff;
-        bitstring &= ~(1 << diff);
+        bitstring &= (1 << diff) - 1;
         nbits = diff;
         write_32_le(dest, destPos, buff, buffBits);
     }
@@ -219,6 +220,8 @@ MAIN COMPRESSION/DECOMPRESSION ROUTINES
  */
 
 unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedSize_p, int bitDepth) {
+    long long profileStart = ProfileBegin();
+
     if (srcSize <= 0)
         goto fail;
 
@@ -227,6 +230,7 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
     unsigned char *dest = malloc(worstCaseDestSize);
     if (dest == NULL)
         goto fail;
+    PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
 
     int nitems = 1 << bitDepth;
 
@@ -325,6 +329,8 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
     }
 
     if (destBitPos != 0) {
+        // The decoder reads from the top bit down, so move the leftover bits up.
+        destBuf <<= 32 - destBitPos;
         write_32_le(dest, &destPos, &destBuf, &destBitPos);
     }
 
@@ -336,6 +342,7 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
     dest[2] = srcSize >> 8;
     dest[3] = srcSize >> 16;
     *compressedSize_p = (destPos + 3) & ~3;
+    ProfileEnd("HuffCompress", NULL, profileStart);
     return dest;
 
 fail:
@@ -343,6 +350,8 @@ fail:
 }
 
 unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompressedSize_p) {
+    long long profileStart = ProfileBegin();
+
     if (srcSize < 4)
         goto fail;
 
@@ -357,6 +366,8 @@ unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompres
     if (dest == NULL)
         goto fail;
 
+    PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+
     int treePos = 5;
     int treeSize = (src[4] + 1) * 2;
     int srcPos = 4 + treeSize;
@@ -384,6 +395,7 @@ unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompres
                     write_32_le(dest, &destPos, &destTmp, &curValPos);
                     if (destPos == destSize) {
                         *uncompressedSize_p = destSize;
+                        ProfileEnd("HuffDecompress", NULL, profileStart);
                         return dest;
                     }
                 }
@@ -4,9 +4,12 @@
 #include <stdbool.h>
 #include "global.h"
 #include "lz.h"
+#include "profile.h"
 
 unsigned char *LZDecompress(unsigned char *src, int srcSize, int *uncompressedSize)
 {
+	long long profileStart = ProfileBegin();
+
 	if (srcSize < 4)
 		goto fail;
 
@@ -17,6 +20,8 @@ unsigned char *LZDecompress(unsigned char *src, int srcSize, int *uncompressedSi
 	if (dest == NULL)
 		goto fail;
 
+	PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+
 	int srcPos = 4;
 	int destPos = 0;
 
@@ -58,6 +63,7 @@ unsigned char *LZDecompress(unsigned char *src, int srcSize, int *uncompressedSi
 
 			if (destPos == destSize) {
 				*uncompressedSize = destSize;
+				ProfileEnd("LZDecompress", NULL, profileStart);
 				return dest;
 			}
 
@@ -71,6 +77,9 @@ fail:
 
 unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
 {
+	long long profileStart = ProfileBegin();
+	long long matchesSearched = 0;
+
 	if (srcSize <= 0)
 		goto fail;
 
@@ -84,6 +93,8 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 	if (dest == NULL)
 		goto fail;
 
+	PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+
 	// header
 	dest[0] = 0x10; // LZ compression type
 	dest[1] = (unsigned char)srcSize;
@@ -122,6 +133,9 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 				blockDistance++;
 			}
 
+			// The search only stops early on a full-length match.
+			matchesSearched += blockDistance - minDistance + (bestBlockSize == 18);
+
 			if (bestBlockSize >= 3) {
 				*flags |= (0x80 >> i);
 				srcPos += bestBlockSize;
@@ -143,6 +157,152 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 				}
 
 				*compressedSize = destPos;
+				PROFILE_COUNT(PROFILE_MATCHES_SEARCHED, matchesSearched);
+				ProfileEnd("LZCompress", NULL, profileStart);
+				return dest;
+			}
+		}
+	}
+
+fail:
+	FATAL_ERROR("Fatal error while compressing LZ file.\n");
+}
+
+// Like LZCompress, but instead of taking the longest match at each position,
+// it picks the sequence of literals and matches with the fewest total bits.
+// Each literal costs 9 bits and each match 17, flag bits included.
+// Any shorter prefix of the longest match is also a match at the same
+// distance, so the longest match at each position is all the parse needs.
+unsigned char *LZCompressOptimal(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	long long profileStart = ProfileBegin();
+	long long matchesSearched = 0;
+
+	if (srcSize <= 0)
+		goto fail;
+
+	int worstCaseDestSize = 4 + srcSize + ((srcSize + 7) / 8);
+
+	// Round up to the next multiple of four.
+	worstCaseDestSize = (worstCaseDestSize + 3) & ~3;
+
+	unsigned char *dest = malloc(worstCaseDestSize);
+	int *head = malloc(0x10000 * sizeof(int));
+	int *prev = malloc(srcSize * sizeof(int));
+	unsigned char *matchSize = malloc(srcSize);
+	unsigned short *matchDistance = malloc(srcSize * sizeof(unsigned short));
+	int *cost = malloc((srcSize + 1) * sizeof(int));
+
+	if (dest == NULL || head == NULL || prev == NULL || matchSize == NULL || matchDistance == NULL || cost == NULL)
+		goto fail;
+
+	PROFILE_COUNT(PROFILE_ALLOCATIONS, 6);
+
+	// Find the longest match at every position, using chains of earlier
+	// positions that start with the same three bytes.
+	for (int i = 0; i < 0x10000; i++)
+		head[i] = -1;
+
+	for (int srcPos = 0; srcPos < srcSize; srcPos++) {
+		matchSize[srcPos] = 0;
+		matchDistance[srcPos] = 0;
+
+		if (srcPos + 3 > srcSize) {
+			prev[srcPos] = -1;
+			continue;
+		}
+
+		int hash = ((src[srcPos] << 8) ^ (src[srcPos + 1] << 4) ^ src[srcPos + 2]) & 0xFFFF;
+		int maxSize = srcSize - srcPos < 18 ? srcSize - srcPos : 18;
+
+		for (int blockStart = head[hash]; blockStart >= 0 && srcPos - blockStart <= 0x1000; blockStart = prev[blockStart]) {
+			if (srcPos - blockStart < minDistance)
+				continue;
+
+			int blockSize = 0;
+
+			matchesSearched++;
+
+			while (blockSize < maxSize && src[blockStart + blockSize] == src[srcPos + blockSize])
+				blockSize++;
+
+			if (blockSize > matchSize[srcPos]) {
+				matchSize[srcPos] = blockSize;
+				matchDistance[srcPos] = srcPos - blockStart;
+
+				if (blockSize == maxSize)
+					break;
+			}
+		}
+
+		prev[srcPos] = head[hash];
+		head[hash] = srcPos;
+	}
+
+	// Work back from the end to find the cheapest way to code each suffix.
+	// matchSize is overwritten with the size of the chosen match, or 0 for a literal.
+	cost[srcSize] = 0;
+
+	for (int srcPos = srcSize - 1; srcPos >= 0; srcPos--) {
+		int bestSize = 0;
+
+		cost[srcPos] = 9 + cost[srcPos + 1];
+
+		for (int blockSize = 3; blockSize <= matchSize[srcPos]; blockSize++) {
+			if (17 + cost[srcPos + blockSize] <= cost[srcPos]) {
+				cost[srcPos] = 17 + cost[srcPos + blockSize];
+				bestSize = blockSize;
+			}
+		}
+
+		matchSize[srcPos] = bestSize;
+	}
+
+	// header
+	dest[0] = 0x10; // LZ compression type
+	dest[1] = (unsigned char)srcSize;
+	dest[2] = (unsigned char)(srcSize >> 8);
+	dest[3] = (unsigned char)(srcSize >> 16);
+
+	int srcPos = 0;
+	int destPos = 4;
+
+	for (;;) {
+		unsigned char *flags = &dest[destPos++];
+		*flags = 0;
+
+		for (int i = 0; i < 8; i++) {
+			int blockSize = matchSize[srcPos];
+
+			if (blockSize != 0) {
+				int blockDistance = matchDistance[srcPos] - 1;
+
+				*flags |= (0x80 >> i);
+				srcPos += blockSize;
+				dest[destPos++] = ((blockSize - 3) << 4) | ((unsigned int)blockDistance >> 8);
+				dest[destPos++] = (unsigned char)blockDistance;
+			} else {
+				dest[destPos++] = src[srcPos++];
+			}
+
+			if (srcPos == srcSize) {
+				// Pad to multiple of 4 bytes.
+				int remainder = destPos % 4;
+
+				if (remainder != 0) {
+					for (int i = 0; i < 4 - remainder; i++)
+						dest[destPos++] = 0;
+				}
+
+				free(head);
+				free(prev);
+				free(matchSize);
+				free(matchDistance);
+				free(cost);
+
+				*compressedSize = destPos;
+				PROFILE_COUNT(PROFILE_MATCHES_SEARCHED, matchesSearched);
+				ProfileEnd("LZCompressOptimal", NULL, profileStart);
 				return dest;
 			}
 		}
@@ -13,6 +13,7 @@
 #include "rl.h"
 #include "font.h"
 #include "huff.h"
+#include "profile.h"
 
 struct CommandHandler
 {
@@ -375,6 +376,7 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
 {
     int overflowSize = 0;
     int minDistance = 2; // default, for compatibility with LZ77UnCompVram()
+    bool optimal = false;
 
     for (int i = 3; i < argc; i++)
     {
@@ -406,6 +408,10 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
             if (minDistance < 1)
                 FATAL_ERROR("LZ min search distance must be positive.\n");
         }
+        else if (strcmp(option, "-optimal") == 0)
+        {
+            optimal = true;
+        }
         else
         {
             FATAL_ERROR("Unrecognized option \"%s\".\n", option);
@@ -422,7 +428,7 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
     unsigned char *buffer = ReadWholeFileZeroPadded(inputPath, &fileSize, overflowSize);
 
     int compressedSize;
-    unsigned char *compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+    unsigned char *compressedData = (optimal ? LZCompressOptimal : LZCompress)(buffer, fileSize + overflowSize, &compressedSize, minDistance);
 
     compressedData[1] = (unsigned char)fileSize;
     compressedData[2] = (unsigned char)(fileSize >> 8);
@@ -539,6 +545,8 @@ int main(int argc, char **argv)
 {
     char converted = 0;
 
+    ProfileInit("gbagfx", &argc, argv);
+
     if (argc < 3)
         FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n");
 
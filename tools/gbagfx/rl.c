@@ -4,9 +4,12 @@
 #include <stdbool.h>
 #include "global.h"
 #include "rl.h"
+#include "profile.h"
 
 unsigned char *RLDecompress(unsigned char *src, int srcSize, int *uncompressedSize)
 {
+    long long profileStart = ProfileBegin();
+
     if (srcSize < 4)
         goto fail;
 
@@ -17,6 +20,8 @@ unsigned char *RLDecompress(unsigned char *src, int srcSize, int *uncompressedSi
     if (dest == NULL)
         goto fail;
 
+    PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+
     int srcPos = 4;
     int destPos = 0;
 
@@ -53,6 +58,7 @@ unsigned char *RLDecompress(unsigned char *src, int srcSize, int *uncompressedSi
         if (destPos == destSize)
         {
             *uncompressedSize = destSize;
+            ProfileEnd("RLDecompress", NULL, profileStart);
             return dest;
         }
     }
@@ -63,6 +69,8 @@ fail:
 
 unsigned char *RLCompress(unsigned char *src, int srcSize, int *compressedSize)
 {
+    long long profileStart = ProfileBegin();
+
     if (srcSize <= 0)
         goto fail;
 
@@ -76,6 +84,8 @@ unsigned char *RLCompress(unsigned char *src, int srcSize, int *compressedSize)
     if (dest == NULL)
         goto fail;
 
+    PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+
     // header
     dest[0] = 0x30; // RL compression type
     dest[1] = (unsigned char)srcSize;
@@ -140,6 +150,7 @@ unsigned char *RLCompress(unsigned char *src, int srcSize, int *compressedSize)
             }
 
             *compressedSize = destPos;
+            ProfileEnd("RLCompress", NULL, profileStart);
             return dest;
         }
     }
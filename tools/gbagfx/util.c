@@ -8,6 +8,7 @@
 #include <limits.h>
 #include "global.h"
 #include "util.h"
+#include "profile.h"
 
 bool ParseNumber(char *s, char **end, int radix, int *intValue)
 {
@@ -88,6 +89,10 @@ unsigned char *ReadWholeFile(char *path, int *size)
 
 	fclose(fp);
 
+	PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+	PROFILE_COUNT(PROFILE_BYTES_READ, *size);
+	PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+
 	return buffer;
 }
 
@@ -114,6 +119,10 @@ unsigned char *ReadWholeFileZeroPadded(char *path, int *size, int padAmount)
 
 	fclose(fp);
 
+	PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+	PROFILE_COUNT(PROFILE_BYTES_READ, *size);
+	PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+
 	return buffer;
 }
 
@@ -128,4 +137,7 @@ void WriteWholeFile(char *path, void *buffer, int bufferSize)
 		FATAL_ERROR("Failed to write to \"%s\".\n", path);
 
 	fclose(fp);
+
+	PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+	PROFILE_COUNT(PROFILE_BYTES_WRITTEN, bufferSize);
 }
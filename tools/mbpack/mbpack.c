@@ -0,0 +1,189 @@
+//---------------------------------------------------------------------------------
+// mbpack.c
+//---------------------------------------------------------------------------------
+/*
+    Packs a multiboot payload for the ROM that sends it.
+
+    The payload ELF is flattened the way objcopy -O binary does it, LZ77
+    compressed and written out as the .lz file the ROM includes, or as an
+    assembly file with the data inline. All of it happens in memory, and the
+    size of the payload is printed against the multiboot limit.
+
+    The payload isn't a cartridge image, so there's no header to fix.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "elf_image.h"
+#include "lz.h"
+#include "profile.h"
+
+#define MULTIBOOT_SEND_SIZE_MAX 0x40000
+
+//---------------------------------------------------------------------------------
+uint8_t *ReadWholeFile(const char *path, size_t *size)
+//---------------------------------------------------------------------------------
+{
+    FILE *fp = fopen(path, "rb");
+    uint8_t *data;
+    long length;
+
+    if (!fp) return NULL;
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) { fclose(fp); return NULL; }
+
+    data = malloc(length ? length : 1);
+    if (!data || fread(data, 1, length, fp) != (size_t)length) { free(data); fclose(fp); return NULL; }
+
+    fclose(fp);
+    *size = length;
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_READ, length);
+    PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+    return data;
+}
+
+//---------------------------------------------------------------------------------
+int WriteAsm(FILE *fp, const char *label, const uint8_t *data, int size)
+/*---------------------------------------------------------------------------------
+    Write the data as .byte directives, 16 to a line
+---------------------------------------------------------------------------------*/
+{
+    int i;
+
+    fprintf(fp, "\t.section .rodata\n\n\t.global %s\n%s:\n", label, label);
+
+    for (i = 0; i < size; i++)
+    {
+        fprintf(fp, (i % 16 == 0) ? "\t.byte 0x%02X" : ", 0x%02X", data[i]);
+        if (i % 16 == 15 || i == size - 1) fputc('\n', fp);
+    }
+
+    return !ferror(fp);
+}
+
+//---------------------------------------------------------------------------------
+int HasExtension(const char *path, const char *extension)
+//---------------------------------------------------------------------------------
+{
+    size_t length = strlen(path), extLength = strlen(extension);
+    return length >= extLength && strcmp(path + length - extLength, extension) == 0;
+}
+
+//---------------------------------------------------------------------------------
+void PrintUsage(void)
+//---------------------------------------------------------------------------------
+{
+    fprintf(stderr, "Usage: mbpack <payload.elf> <out.lz | out.s> [options]\n"
+                    "Options:\n"
+                    "  -search <n>    minimum LZ77 match distance (default 2)\n"
+                    "  -greedy        use gbagfx's greedy LZ77 parse instead of the optimal one\n"
+                    "  -label <name>  label for the data in an assembly file (default gPayload)\n"
+                    "  -limit <n>     largest payload allowed (default 0x%X, the multiboot limit)\n"
+                    "  -silent        don't print the payload size\n",
+                    MULTIBOOT_SEND_SIZE_MAX);
+}
+
+//---------------------------------------------------------------------------------
+int main(int argc, char **argv)
+//---------------------------------------------------------------------------------
+{
+    const char *elfPath, *outPath;
+    const char *label = "gPayload";
+    int minDistance = 2;
+    int greedy = 0;
+    unsigned long limit = MULTIBOOT_SEND_SIZE_MAX;
+    int silent = 0;
+    uint8_t *elf, *image, *compressed;
+    size_t elfSize;
+    ElfImage elfImage;
+    const char *error;
+    int compressedSize;
+    FILE *fp;
+    int ok;
+    int i;
+
+    ProfileInit("mbpack", &argc, argv);
+
+    if (argc < 3)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    elfPath = argv[1];
+    outPath = argv[2];
+
+    for (i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-search") == 0 && i + 1 < argc)
+        {
+            minDistance = (int)strtol(argv[++i], NULL, 0);
+            if (minDistance < 1 || minDistance > 0x1000) { fprintf(stderr, "LZ min search distance must be from 1 to 4096.\n"); return 1; }
+        }
+        else if (strcmp(argv[i], "-greedy") == 0) greedy = 1;
+        else if (strcmp(argv[i], "-label") == 0 && i + 1 < argc) label = argv[++i];
+        else if (strcmp(argv[i], "-limit") == 0 && i + 1 < argc) limit = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-silent") == 0) silent = 1;
+        else
+        {
+            fprintf(stderr, "Unrecognized option \"%s\".\n", argv[i]);
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    elf = ReadWholeFile(elfPath, &elfSize);
+    if (!elf) { fprintf(stderr, "Failed to read \"%s\".\n", elfPath); return 1; }
+
+    error = GetElfImage(&elfImage, elf, elfSize);
+    if (error) { fprintf(stderr, "%s: %s\n", elfPath, error); return 1; }
+
+    if (elfImage.size > limit)
+    {
+        fprintf(stderr, "%s: payload is 0x%X bytes, over the limit of 0x%lX by 0x%lX bytes.\n",
+                elfPath, elfImage.size, limit, elfImage.size - limit);
+        return 1;
+    }
+
+    // The LZ header only has 24 bits for the size.
+    if (elfImage.size >= (1 << 24)) { fprintf(stderr, "%s: payload is too large to LZ77 compress.\n", elfPath); return 1; }
+
+    image = calloc(elfImage.size, 1);
+    if (!image) { fprintf(stderr, "Out of memory.\n"); return 1; }
+    PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+    CopyElfImage(&elfImage, image);
+
+    compressed = (greedy ? LZCompress : LZCompressOptimal)(image, elfImage.size, &compressedSize, minDistance);
+
+    fp = fopen(outPath, "wb");
+    if (!fp) { fprintf(stderr, "Failed to open \"%s\" for writing.\n", outPath); return 1; }
+
+    if (HasExtension(outPath, ".s"))
+        ok = WriteAsm(fp, label, compressed, compressedSize);
+    else
+        ok = fwrite(compressed, 1, compressedSize, fp) == (size_t)compressedSize;
+
+    if (fclose(fp) != 0 || !ok)
+    {
+        fprintf(stderr, "Failed to write \"%s\".\n", outPath);
+        remove(outPath);
+        return 1;
+    }
+
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_WRITTEN, compressedSize);
+
+    if (!silent)
+        printf("%s: 0x%X of 0x%lX bytes (%.1f%%), 0x%X bytes compressed (%.1f%%)\n",
+               elfPath, elfImage.size, limit, 100.0 * elfImage.size / limit,
+               compressedSize, 100.0 * compressedSize / elfImage.size);
+
+    free(compressed);
+    free(image);
+    free(elf);
+    return 0;
+}
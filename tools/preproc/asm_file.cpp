@@ -27,150 +27,45 @@
 #include "utf8.h"
 #include "string_parser.h"
 
-AsmFile::AsmFile(std::string filename) : m_filename(filename)
+AsmFile::AsmFile(std::string filename, std::string& output) : m_filename(filename), m_output(&output)
 {
-    FILE *fp = std::fopen(filename.c_str(), "rb");
+    m_source = g_sourceCache.Load(filename);
 
-    if (fp == NULL)
+    if (!m_source)
         FATAL_ERROR("Failed to open \"%s\" for reading.\n", filename.c_str());
 
-    std::fseek(fp, 0, SEEK_END);
-
-    m_size = std::ftell(fp);
-
-    if (m_size < 0)
-        FATAL_ERROR("File size of \"%s\" is less than zero.\n", filename.c_str());
-
-    m_buffer = new char[m_size + 1];
-
-    std::rewind(fp);
-
-    if (std::fread(m_buffer, m_size, 1, fp) != 1)
-        FATAL_ERROR("Failed to read \"%s\".\n", filename.c_str());
-
-    m_buffer[m_size] = 0;
-
-    std::fclose(fp);
-
+    m_buffer = reinterpret_cast<const char*>(m_source->Data());
+    m_size = m_source->Size();
     m_pos = 0;
     m_lineNum = 1;
     m_lineStart = 0;
-
-    RemoveComments();
 }
 
-AsmFile::AsmFile(AsmFile&& other) : m_filename(std::move(other.m_filename))
+AsmFile::AsmFile(AsmFile&& other) : m_source(std::move(other.m_source)), m_filename(std::move(other.m_filename))
 {
     m_buffer = other.m_buffer;
     m_pos = other.m_pos;
     m_size = other.m_size;
     m_lineNum = other.m_lineNum;
     m_lineStart = other.m_lineStart;
+    m_output = other.m_output;
 
     other.m_buffer = nullptr;
 }
 
-AsmFile::~AsmFile()
-{
-    delete[] m_buffer;
-}
-
-// Removes comments to simplify further processing.
-// It stops upon encountering a null character,
-// which may or may not be the end of file marker.
-// If it's not, the error will be caught later.
-void AsmFile::RemoveComments()
-{
-    long pos = 0;
-    char stringChar = 0;
-
-    for (;;)
-    {
-        if (m_buffer[pos] == 0)
-            return;
-
-        if (stringChar != 0)
-        {
-            if (m_buffer[pos] == '\\' && m_buffer[pos + 1] == stringChar)
-            {
-                pos += 2;
-            }
-            else
-            {
-                if (m_buffer[pos] == stringChar)
-                    stringChar = 0;
-                pos++;
-            }
-        }
-        else if (m_buffer[pos] == '@' && (pos == 0 || m_buffer[pos - 1] != '\\'))
-        {
-            while (m_buffer[pos] != '\n' && m_buffer[pos] != 0)
-                m_buffer[pos++] = ' ';
-        }
-        else if (m_buffer[pos] == '/' && m_buffer[pos + 1] == '*')
-        {
-            m_buffer[pos++] = ' ';
-            m_buffer[pos++] = ' ';
-
-            for (;;)
-            {
-                if (m_buffer[pos] == 0)
-                    return;
-
-                if (m_buffer[pos] == '*' && m_buffer[pos + 1] == '/')
-                {
-                    m_buffer[pos++] = ' ';
-                    m_buffer[pos++] = ' ';
-                    break;
-                }
-                else
-                {
-                    if (m_buffer[pos] != '\n')
-                        m_buffer[pos] = ' ';
-                    pos++;
-                }
-            }
-        }
-        else
-        {
-            if (m_buffer[pos] == '"' || m_buffer[pos] == '\'')
-                stringChar = m_buffer[pos];
-            pos++;
-        }
-    }
-}
-
-// Checks if we're at a particular directive and if so, consumes it.
-// Returns whether the directive was found.
-bool AsmFile::CheckForDirective(std::string name)
-{
-    long i;
-    long length = static_cast<long>(name.length());
-
-    for (i = 0; i < length && m_pos + i < m_size; i++)
-        if (name[i] != m_buffer[m_pos + i])
-            return false;
-
-    if (i < length)
-        return false;
-
-    m_pos += length;
-
-    return true;
-}
-
 // Checks if we're at a known directive and if so, consumes it.
 // Returns which directive was found.
 Directive AsmFile::GetDirective()
 {
     SkipWhitespace();
 
-    if (CheckForDirective(".include"))
-        return Directive::Include;
-    else if (CheckForDirective(".string"))
-        return Directive::String;
-    else
-        return Directive::Unknown;
+    long length;
+    Directive directive = MatchDirective(&m_buffer[m_pos], length);
+
+    if (directive != Directive::Unknown)
+        m_pos += length;
+
+    return directive;
 }
 
 // Checks if we're at label that ends with '::'.
@@ -357,15 +252,15 @@ int AsmFile::ReadPadLength()
 // Outputs the current line and moves to the next one.
 void AsmFile::OutputLine()
 {
-    while (m_buffer[m_pos] != '\n' && m_buffer[m_pos] != 0)
-        m_pos++;
+    m_pos = FindAny(&m_buffer[m_pos], '\n', 0, 0, 0, 0) - m_buffer;
 
     if (m_buffer[m_pos] == 0)
     {
         if (m_pos >= m_size)
         {
             RaiseWarning("file doesn't end with newline");
-            puts(&m_buffer[m_lineStart]);
+            m_output->append(&m_buffer[m_lineStart], m_pos - m_lineStart);
+            *m_output += '\n';
         }
         else
         {
@@ -374,9 +269,7 @@ void AsmFile::OutputLine()
     }
     else
     {
-        m_buffer[m_pos] = 0;
-        puts(&m_buffer[m_lineStart]);
-        m_buffer[m_pos] = '\n';
+        m_output->append(&m_buffer[m_lineStart], m_pos + 1 - m_lineStart);
         m_pos++;
         m_lineStart = m_pos;
         m_lineNum++;
@@ -422,36 +315,39 @@ bool AsmFile::IsAtEnd()
 // Output the current location to set gas's logical file and line numbers.
 void AsmFile::OutputLocation()
 {
-    std::printf("# %ld \"%s\"\n", m_lineNum, m_filename.c_str());
+    *m_output += "# " + std::to_string(m_lineNum) + " \"" + m_filename + "\"\n";
 }
 
-// Reports a diagnostic message.
-void AsmFile::ReportDiagnostic(const char* type, const char* format, std::va_list args)
+// Formats a diagnostic message.
+std::string AsmFile::FormatDiagnostic(const char* type, const char* format, std::va_list args)
 {
     const int bufferSize = 1024;
     char buffer[bufferSize];
     std::vsnprintf(buffer, bufferSize, format, args);
-    std::fprintf(stderr, "%s:%ld: %s: %s\n", m_filename.c_str(), m_lineNum, type, buffer);
+    return m_filename + ":" + std::to_string(m_lineNum) + ": " + type + ": " + buffer + "\n";
 }
 
-#define DO_REPORT(type)                   \
-do                                        \
-{                                         \
-    std::va_list args;                    \
-    va_start(args, format);               \
-    ReportDiagnostic(type, format, args); \
-    va_end(args);                         \
+#define FORMAT_DIAGNOSTIC(type, message)              \
+do                                                    \
+{                                                     \
+    std::va_list args;                                \
+    va_start(args, format);                           \
+    message = FormatDiagnostic(type, format, args);   \
+    va_end(args);                                     \
 } while (0)
 
-// Reports an error diagnostic and terminates the program.
+// Reports an error diagnostic and stops preprocessing.
 void AsmFile::RaiseError(const char* format, ...)
 {
-    DO_REPORT("error");
-    std::exit(1);
+    std::string message;
+    FORMAT_DIAGNOSTIC("error", message);
+    throw PreprocError{ message };
 }
 
 // Reports a warning diagnostic.
 void AsmFile::RaiseWarning(const char* format, ...)
 {
-    DO_REPORT("warning");
+    std::string message;
+    FORMAT_DIAGNOSTIC("warning", message);
+    std::fputs(message.c_str(), stderr);
 }
@@ -23,23 +23,17 @@
 
 #include <cstdarg>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include "preproc.h"
-
-enum class Directive
-{
-    Include,
-    String,
-    Unknown
-};
+#include "asm_scan.h"
 
 class AsmFile
 {
 public:
-    AsmFile(std::string filename);
+    AsmFile(std::string filename, std::string& output);
     AsmFile(AsmFile&& other);
     AsmFile(const AsmFile&) = delete;
-    ~AsmFile();
     Directive GetDirective();
     std::string GetGlobalLabel();
     std::string ReadPath();
@@ -49,21 +43,22 @@ public:
     void OutputLocation();
 
 private:
-    char* m_buffer;
+    // Shared with every other AsmFile for the same file, so it's never modified.
+    std::shared_ptr<const MappedFile> m_source;
+    const char* m_buffer;
     long m_pos;
     long m_size;
     long m_lineNum;
     long m_lineStart;
     std::string m_filename;
+    std::string* m_output;
 
     bool ConsumeComma();
     int ReadPadLength();
-    void RemoveComments();
-    bool CheckForDirective(std::string name);
     void SkipWhitespace();
     void ExpectEmptyRestOfLine();
-    void ReportDiagnostic(const char* type, const char* format, std::va_list args);
-    void RaiseError(const char* format, ...);
+    std::string FormatDiagnostic(const char* type, const char* format, std::va_list args);
+    [[noreturn]] void RaiseError(const char* format, ...);
     void RaiseWarning(const char* format, ...);
     void VerifyStringLength(int length);
 };
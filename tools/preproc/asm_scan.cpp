@@ -0,0 +1,162 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+#include "asm_scan.h"
+#include "char_util.h"
+
+// Blanks out a block comment's contents, keeping newlines so that line numbers don't change.
+static void BlankKeepingNewlines(char* start, char* end)
+{
+    while (start < end)
+    {
+        char* newline = static_cast<char*>(std::memchr(start, '\n', end - start));
+
+        if (newline == nullptr)
+            newline = end;
+
+        std::memset(start, ' ', newline - start);
+        start = newline + 1;
+    }
+}
+
+// Removes comments to simplify further processing.
+// It stops upon encountering a null character,
+// which may or may not be the end of file marker.
+// If it's not, the error will be caught later.
+// Rather than checking every byte, it skips ahead to the next byte that
+// can change the state: a comment or string start outside of strings,
+// and the closing quote or a backslash inside them.
+void RemoveAsmComments(char* buffer)
+{
+    char* p = buffer;
+    char stringChar = 0;
+
+    for (;;)
+    {
+        if (stringChar != 0)
+        {
+            p = FindAny(p, stringChar, '\\', 0, 0, 0);
+
+            if (*p == 0)
+                return;
+
+            if (*p == '\\' && p[1] == stringChar)
+            {
+                p += 2;
+            }
+            else
+            {
+                if (*p == stringChar)
+                    stringChar = 0;
+                p++;
+            }
+        }
+        else
+        {
+            p = FindAny(p, '@', '/', '"', '\'', 0);
+
+            if (*p == 0)
+                return;
+
+            if (*p == '@' && (p == buffer || p[-1] != '\\'))
+            {
+                char* end = FindAny(p, '\n', 0, 0, 0, 0);
+                std::memset(p, ' ', end - p);
+                p = end;
+            }
+            else if (*p == '/' && p[1] == '*')
+            {
+                *p++ = ' ';
+                *p++ = ' ';
+
+                for (;;)
+                {
+                    char* star = FindAny(p, '*', 0, 0, 0, 0);
+
+                    BlankKeepingNewlines(p, star);
+                    p = star;
+
+                    if (*p == 0)
+                        return;
+
+                    if (p[1] == '/')
+                    {
+                        *p++ = ' ';
+                        *p++ = ' ';
+                        break;
+                    }
+
+                    *p++ = ' ';
+                }
+            }
+            else
+            {
+                if (*p == '"' || *p == '\'')
+                    stringChar = *p;
+                p++;
+            }
+        }
+    }
+}
+
+struct DirectiveName
+{
+    const char* name;
+    Directive directive;
+};
+
+// The directives preproc handles, indexed by the length of their name.
+// The length alone tells them apart, so this is a perfect hash.
+static const DirectiveName s_directivesByLength[] = {
+    { nullptr, Directive::Unknown },
+    { nullptr, Directive::Unknown },
+    { nullptr, Directive::Unknown },
+    { nullptr, Directive::Unknown },
+    { nullptr, Directive::Unknown },
+    { nullptr, Directive::Unknown },
+    { "string", Directive::String },
+    { "include", Directive::Include },
+};
+
+// Checks if s is at a directive that preproc handles.
+// Returns which one, and sets length to the length of the directive including the dot.
+Directive MatchDirective(const char* s, long& length)
+{
+    if (s[0] != '.')
+        return Directive::Unknown;
+
+    long nameLength = 0;
+
+    while (IsIdentifierChar(s[1 + nameLength]))
+        nameLength++;
+
+    if (nameLength >= static_cast<long>(sizeof(s_directivesByLength) / sizeof(s_directivesByLength[0])))
+        return Directive::Unknown;
+
+    const DirectiveName& entry = s_directivesByLength[nameLength];
+
+    if (entry.name == nullptr || std::memcmp(s + 1, entry.name, nameLength) != 0)
+        return Directive::Unknown;
+
+    length = 1 + nameLength;
+
+    return entry.directive;
+}
@@ -0,0 +1,80 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef ASM_SCAN_H
+#define ASM_SCAN_H
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Buffers scanned with FindAny must have this many readable bytes after their null terminator.
+const int kScanPadding = 16;
+
+enum class Directive
+{
+    Include,
+    String,
+    Unknown
+};
+
+// Returns a pointer to the first byte at or after p that equals a, b, c, d or e.
+// One of them must be 0 so that the scan stops at the null terminator.
+// With SSE2, 16 bytes are compared at a time, so the scan can read up to
+// kScanPadding - 1 bytes past the terminator.
+inline const char* FindAny(const char* p, char a, char b, char c, char d, char e)
+{
+#ifdef __SSE2__
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    const __m128i vd = _mm_set1_epi8(d);
+    const __m128i ve = _mm_set1_epi8(e);
+
+    for (;;)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i matches = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, vc), _mm_cmpeq_epi8(chunk, vd)), _mm_cmpeq_epi8(chunk, ve)));
+        int mask = _mm_movemask_epi8(matches);
+
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+
+        p += 16;
+    }
+#else
+    while (*p != a && *p != b && *p != c && *p != d && *p != e)
+        p++;
+
+    return p;
+#endif // __SSE2__
+}
+
+inline char* FindAny(char* p, char a, char b, char c, char d, char e)
+{
+    return const_cast<char*>(FindAny(const_cast<const char*>(p), a, b, c, d, e));
+}
+
+void RemoveAsmComments(char* buffer);
+Directive MatchDirective(const char* s, long& length);
+
+#endif // ASM_SCAN_H
@@ -0,0 +1,253 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Compares the vectorized scanning in asm_scan.cpp with the scalar loops it replaced.
+// Run with "make bench".
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "asm_scan.h"
+
+static void RemoveCommentsScalar(char* buffer)
+{
+    long pos = 0;
+    char stringChar = 0;
+
+    for (;;)
+    {
+        if (buffer[pos] == 0)
+            return;
+
+        if (stringChar != 0)
+        {
+            if (buffer[pos] == '\\' && buffer[pos + 1] == stringChar)
+            {
+                pos += 2;
+            }
+            else
+            {
+                if (buffer[pos] == stringChar)
+                    stringChar = 0;
+                pos++;
+            }
+        }
+        else if (buffer[pos] == '@' && (pos == 0 || buffer[pos - 1] != '\\'))
+        {
+            while (buffer[pos] != '\n' && buffer[pos] != 0)
+                buffer[pos++] = ' ';
+        }
+        else if (buffer[pos] == '/' && buffer[pos + 1] == '*')
+        {
+            buffer[pos++] = ' ';
+            buffer[pos++] = ' ';
+
+            for (;;)
+            {
+                if (buffer[pos] == 0)
+                    return;
+
+                if (buffer[pos] == '*' && buffer[pos + 1] == '/')
+                {
+                    buffer[pos++] = ' ';
+                    buffer[pos++] = ' ';
+                    break;
+                }
+                else
+                {
+                    if (buffer[pos] != '\n')
+                        buffer[pos] = ' ';
+                    pos++;
+                }
+            }
+        }
+        else
+        {
+            if (buffer[pos] == '"' || buffer[pos] == '\'')
+                stringChar = buffer[pos];
+            pos++;
+        }
+    }
+}
+
+static bool CheckForDirectiveScalar(const char* s, std::string name)
+{
+    for (std::size_t i = 0; i < name.length(); i++)
+        if (name[i] != s[i])
+            return false;
+
+    return true;
+}
+
+// Walks the lines like PreprocAsmFile does and counts the directives.
+template <typename Match>
+static long CountDirectives(const char* buffer, Match match)
+{
+    const char* p = buffer;
+    long count = 0;
+
+    while (*p != 0)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+
+        count += match(p);
+
+        while (*p != '\n' && *p != 0)
+            p++;
+
+        if (*p == '\n')
+            p++;
+    }
+
+    return count;
+}
+
+static long CountDirectivesScalar(const char* buffer)
+{
+    return CountDirectives(buffer, [](const char* p) -> long {
+        if (CheckForDirectiveScalar(p, ".include"))
+            return 1;
+        if (CheckForDirectiveScalar(p, ".string"))
+            return 2;
+        return 0;
+    });
+}
+
+static long CountDirectivesVector(const char* buffer)
+{
+    const char* p = buffer;
+    long count = 0;
+
+    while (*p != 0)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+
+        long length;
+
+        switch (MatchDirective(p, length))
+        {
+        case Directive::Include:
+            count += 1;
+            break;
+        case Directive::String:
+            count += 2;
+            break;
+        case Directive::Unknown:
+            break;
+        }
+
+        p = FindAny(p, '\n', 0, 0, 0, 0);
+
+        if (*p == '\n')
+            p++;
+    }
+
+    return count;
+}
+
+// Builds a large file that looks like generated data and text assembly.
+static std::string MakeInput(std::size_t size)
+{
+    static const char* const lines[] = {
+        "\t.4byte 0x08001234, 0x08005678 @ pointers\n",
+        "\t.byte 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08\n",
+        "gSomeLabel:: @ a label\n",
+        "\t.string \"Hello, world! @ not a comment\"\n",
+        "\t.include \"asm/macros.inc\"\n",
+        "/* a block comment\n   spanning lines */ \t.2byte 5\n",
+        "\tmov r0, #0x40 @ 'quoted' comment\n",
+        "\t.ascii \"escaped \\\" quote\"\n",
+        "\t.align 2, 0\n",
+    };
+    std::string input;
+    unsigned int seed = 1;
+
+    while (input.size() < size)
+    {
+        seed = seed * 1103515245 + 12345;
+        input += lines[(seed >> 16) % (sizeof(lines) / sizeof(lines[0]))];
+    }
+
+    return input;
+}
+
+template <typename Func>
+static double Time(Func func, int iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; i++)
+        func();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t size = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) << 20 : 32 << 20;
+    const int iterations = 5;
+    std::string input = MakeInput(size);
+    std::vector<char> scalar(input.size() + 1 + kScanPadding, 0);
+    std::vector<char> vector(input.size() + 1 + kScanPadding, 0);
+    double megabytes = input.size() / (1024.0 * 1024.0);
+
+    double scalarTime = Time([&]() {
+        std::memcpy(scalar.data(), input.data(), input.size());
+        RemoveCommentsScalar(scalar.data());
+    }, iterations);
+
+    double vectorTime = Time([&]() {
+        std::memcpy(vector.data(), input.data(), input.size());
+        RemoveAsmComments(vector.data());
+    }, iterations);
+
+    if (scalar != vector)
+    {
+        std::fprintf(stderr, "RemoveAsmComments output differs from the scalar loop.\n");
+        return 1;
+    }
+
+    std::printf("remove comments:  scalar %8.1f MB/s  vector %8.1f MB/s  (%.2fx)\n",
+        megabytes / scalarTime, megabytes / vectorTime, scalarTime / vectorTime);
+
+    long scalarCount = 0;
+    long vectorCount = 0;
+
+    scalarTime = Time([&]() { scalarCount = CountDirectivesScalar(scalar.data()); }, iterations);
+    vectorTime = Time([&]() { vectorCount = CountDirectivesVector(vector.data()); }, iterations);
+
+    if (scalarCount != vectorCount)
+    {
+        std::fprintf(stderr, "MatchDirective found different directives from the scalar loop.\n");
+        return 1;
+    }
+
+    std::printf("scan directives:  scalar %8.1f MB/s  vector %8.1f MB/s  (%.2fx)\n",
+        megabytes / scalarTime, megabytes / vectorTime, scalarTime / vectorTime);
+
+    return 0;
+}
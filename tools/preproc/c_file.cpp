@@ -25,13 +25,16 @@
 #include <memory>
 #include <cstring>
 #include <cerrno>
+#include <ctime>
 #include "preproc.h"
 #include "c_file.h"
 #include "char_util.h"
 #include "utf8.h"
 #include "string_parser.h"
+#include "asm_scan.h"
+#include "profile.h"
 
-CFile::CFile(const char * filenameCStr, bool isStdin)
+CFile::CFile(const char * filenameCStr, bool isStdin, bool incbinAsm)
 {
     FILE *fp;
 
@@ -49,12 +52,12 @@ CFile::CFile(const char * filenameCStr, bool isStdin)
         FATAL_ERROR("Failed to open \"%s\" for reading.\n", filename.c_str());
 
     m_size = 0;
-    m_buffer = (char *)malloc(CHUNK_SIZE + 1);
+    m_buffer = (char *)malloc(CHUNK_SIZE + 1 + kScanPadding);
     if (m_buffer == NULL) {
         FATAL_ERROR("Failed to allocate memory to process file \"%s\"!", filename.c_str());
     }
 
-    std::size_t numAllocatedBytes = CHUNK_SIZE + 1;
+    std::size_t numAllocatedBytes = CHUNK_SIZE + 1 + kScanPadding;
     std::size_t bufferOffset = 0;
     std::size_t count;
 
@@ -77,22 +80,29 @@ CFile::CFile(const char * filenameCStr, bool isStdin)
         }
     }
 
-    m_buffer[m_size] = 0;
+    std::memset(m_buffer + m_size, 0, 1 + kScanPadding);
 
     std::fclose(fp);
 
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_READ, m_size);
+
     m_pos = 0;
     m_lineNum = 1;
+    m_braceDepth = 0;
     m_isStdin = isStdin;
+    m_incbinAsm = incbinAsm;
 }
 
-CFile::CFile(CFile&& other) : m_filename(std::move(other.m_filename))
+CFile::CFile(CFile&& other) : m_filename(std::move(other.m_filename)), m_output(std::move(other.m_output))
 {
     m_buffer = other.m_buffer;
     m_pos = other.m_pos;
     m_size = other.m_size;
     m_lineNum = other.m_lineNum;
+    m_braceDepth = other.m_braceDepth;
     m_isStdin = other.m_isStdin;
+    m_incbinAsm = other.m_incbinAsm;
 
     other.m_buffer = NULL;
 }
@@ -102,7 +112,8 @@ CFile::~CFile()
     free(m_buffer);
 }
 
-void CFile::Preproc()
+// Appends the preprocessed file to output.
+void CFile::Preproc(std::string& output)
 {
     char stringChar = 0;
 
@@ -112,21 +123,21 @@ void CFile::Preproc()
         {
             if (m_buffer[m_pos] == stringChar)
             {
-                std::putchar(stringChar);
+                OutputChar(stringChar);
                 m_pos++;
                 stringChar = 0;
             }
             else if (m_buffer[m_pos] == '\\' && m_buffer[m_pos + 1] == stringChar)
             {
-                std::putchar('\\');
-                std::putchar(stringChar);
+                OutputChar('\\');
+                OutputChar(stringChar);
                 m_pos += 2;
             }
             else
             {
                 if (m_buffer[m_pos] == '\n')
                     m_lineNum++;
-                std::putchar(m_buffer[m_pos]);
+                OutputChar(m_buffer[m_pos]);
                 m_pos++;
             }
         }
@@ -140,7 +151,7 @@ void CFile::Preproc()
 
             char c = m_buffer[m_pos++];
 
-            std::putchar(c);
+            OutputChar(c);
 
             if (c == '\n')
                 m_lineNum++;
@@ -148,8 +159,15 @@ void CFile::Preproc()
                 stringChar = '"';
             else if (c == '\'')
                 stringChar = '\'';
+            else if (c == '{')
+                m_braceDepth++;
+            else if (c == '}')
+                m_braceDepth--;
         }
     }
+
+    output += m_output;
+    m_output.clear();
 }
 
 bool CFile::ConsumeHorizontalWhitespace()
@@ -169,7 +187,7 @@ bool CFile::ConsumeNewline()
     {
         m_pos += 2;
         m_lineNum++;
-        std::putchar('\n');
+        OutputChar('\n');
         return true;
     }
 
@@ -177,7 +195,7 @@ bool CFile::ConsumeNewline()
     {
         m_pos++;
         m_lineNum++;
-        std::putchar('\n');
+        OutputChar('\n');
         return true;
     }
 
@@ -220,7 +238,7 @@ void CFile::TryConvertString()
 
     SkipWhitespace();
 
-    std::printf("{ ");
+    OutputFormat("{ ");
 
     while (1)
     {
@@ -242,7 +260,7 @@ void CFile::TryConvertString()
             }
 
             for (int i = 0; i < length; i++)
-                printf("0x%02X, ", s[i]);
+                OutputFormat("0x%02X, ", s[i]);
         }
         else if (m_buffer[m_pos] == ')')
         {
@@ -261,9 +279,9 @@ void CFile::TryConvertString()
     }
 
     if (noTerminator)
-        std::printf(" }");
+        OutputFormat(" }");
     else
-        std::printf("0xFF }");
+        OutputFormat("0xFF }");
 }
 
 bool CFile::CheckIdentifier(const std::string& ident)
@@ -297,9 +315,24 @@ std::unique_ptr<unsigned char[]> CFile::ReadWholeFile(const std::string& path, i
 
     std::fclose(fp);
 
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_READ, size);
+    PROFILE_COUNT(PROFILE_ALLOCATIONS, 1);
+
     return buffer;
 }
 
+long CFile::GetFileSize(const std::string& path)
+{
+    long size;
+    long mtime;
+
+    if (!GetFileInfo(path, size, mtime))
+        RaiseError("Failed to open \"%s\" for reading.\n", path.c_str());
+
+    return size;
+}
+
 int ExtractData(const std::unique_ptr<unsigned char[]>& buffer, int offset, int size)
 {
     switch (size)
@@ -355,7 +388,24 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("{");
+    IncbinDeclaration decl;
+    bool asAsm = m_incbinAsm && m_braceDepth == 0 && FindIncbinDeclaration(decl);
+
+    if (!asAsm)
+        OutputFormat("{");
+
+    std::vector<std::string> paths = ReadIncbinPaths();
+
+    if (asAsm)
+        OutputIncbinAsm(decl, paths, size);
+    else
+        OutputIncbinLiterals(paths, size, isSigned);
+}
+
+// Reads the comma-separated path strings of an INCBIN and the closing parenthesis.
+std::vector<std::string> CFile::ReadIncbinPaths()
+{
+    std::vector<std::string> paths;
 
     while (true)
     {
@@ -387,30 +437,10 @@ void CFile::TryConvertIncbin()
             m_pos++;
         }
 
-        std::string path(&m_buffer[startPos], m_pos - startPos);
+        paths.push_back(std::string(&m_buffer[startPos], m_pos - startPos));
 
         m_pos++;
 
-        int fileSize;
-        std::unique_ptr<unsigned char[]> buffer = ReadWholeFile(path, fileSize);
-
-        if ((fileSize % size) != 0)
-            RaiseError("Size %d doesn't evenly divide file size %d.\n", size, fileSize);
-
-        int count = fileSize / size;
-        int offset = 0;
-
-        for (int i = 0; i < count; i++)
-        {
-            int data = ExtractData(buffer, offset, size);
-            offset += size;
-
-            if (isSigned)
-                std::printf("%d,", data);
-            else
-                std::printf("%uu,", data);
-        }
-
         SkipWhitespace();
 
         if (m_buffer[m_pos] != ',')
@@ -424,36 +454,265 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("}");
+    return paths;
+}
+
+// Formats the contents of a file as comma-terminated integer literals.
+// Files are only read and formatted the first time they are seen.
+const std::string& CFile::GetIncbinLiterals(const std::string& path, int size, bool isSigned)
+{
+    IncbinKey key;
+
+    key.path = path;
+    key.size = size;
+    key.isSigned = isSigned;
+
+    // A file modified in the same second it's read could change again without its
+    // mtime moving, so its literals aren't shared with other processes.
+    long readTime = static_cast<long>(std::time(nullptr));
+
+    if (!GetFileInfo(path, key.fileSize, key.mtime))
+        RaiseError("Failed to open \"%s\" for reading.\n", path.c_str());
+
+    const std::string* cached = g_incbinCache.Find(key);
+
+    if (cached != nullptr)
+        return *cached;
+
+    int fileSize;
+    std::unique_ptr<unsigned char[]> buffer = ReadWholeFile(path, fileSize);
+
+    if ((fileSize % size) != 0)
+        RaiseError("Size %d doesn't evenly divide file size %d.\n", size, fileSize);
+
+    int count = fileSize / size;
+    int offset = 0;
+    std::string text;
+    char literal[16];
+
+    for (int i = 0; i < count; i++)
+    {
+        int data = ExtractData(buffer, offset, size);
+        offset += size;
+
+        if (isSigned)
+            std::snprintf(literal, sizeof(literal), "%d,", data);
+        else
+            std::snprintf(literal, sizeof(literal), "%uu,", data);
+
+        text += literal;
+    }
+
+    return *g_incbinCache.Insert(key, std::move(text), key.mtime < readTime);
+}
+
+// Outputs the contents of the files as a brace-enclosed list of integer literals.
+void CFile::OutputIncbinLiterals(const std::vector<std::string>& paths, int size, bool isSigned)
+{
+    for (const std::string& path : paths)
+        m_output += GetIncbinLiterals(path, size, isSigned);
+
+    OutputFormat("}");
+}
+
+static bool IsWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Looks back through the output for the array declaration that the INCBIN
+// initializer belongs to, i.e. "static const u16 sFoo[] = ".
+// Only simple file-scope declarations with an unspecified size are recognized,
+// since anything else can't be replaced by a symbol. The symbol goes in .rodata,
+// so arrays that aren't const keep the literal initializer and stay writable.
+bool CFile::FindIncbinDeclaration(IncbinDeclaration& decl)
+{
+    std::size_t pos = m_output.size();
+
+    while (pos > 0 && IsWhitespace(m_output[pos - 1]))
+        pos--;
+
+    if (pos == 0 || m_output[pos - 1] != '=')
+        return false;
+
+    pos--;
+
+    while (pos > 0 && IsWhitespace(m_output[pos - 1]))
+        pos--;
+
+    if (pos == 0 || m_output[pos - 1] != ']')
+        return false;
+
+    pos--;
+
+    while (pos > 0 && IsWhitespace(m_output[pos - 1]))
+        pos--;
+
+    if (pos == 0 || m_output[pos - 1] != '[')
+        return false;
+
+    pos--;
+    decl.bracketPos = pos;
+
+    while (pos > 0 && IsWhitespace(m_output[pos - 1]))
+        pos--;
+
+    std::size_t nameEnd = pos;
+
+    while (pos > 0 && IsIdentifierChar(m_output[pos - 1]))
+        pos--;
+
+    if (pos == nameEnd || !IsIdentifierStartingChar(m_output[pos]))
+        return false;
+
+    decl.name = m_output.substr(pos, nameEnd - pos);
+
+    // The specifiers run back to the end of the previous declaration.
+    std::size_t nameStart = pos;
+    std::size_t boundary = nameStart == 0 ? std::string::npos : m_output.find_last_of(";}", nameStart - 1);
+    bool atLineStart = (boundary == std::string::npos);
+
+    decl.start = std::string::npos;
+    decl.staticPos = std::string::npos;
+    bool isConst = false;
+
+    for (pos = (boundary == std::string::npos) ? 0 : boundary + 1; pos < nameStart; pos++)
+    {
+        char c = m_output[pos];
+
+        if (c == '\n')
+        {
+            atLineStart = true;
+        }
+        else if (c == '#' && atLineStart)
+        {
+            // Skip line markers.
+            while (pos + 1 < nameStart && m_output[pos + 1] != '\n')
+                pos++;
+        }
+        else if (IsIdentifierStartingChar(c))
+        {
+            std::size_t tokenStart = pos;
+
+            while (pos + 1 < nameStart && IsIdentifierChar(m_output[pos + 1]))
+                pos++;
+
+            if (decl.start == std::string::npos)
+                decl.start = tokenStart;
+
+            if (m_output.compare(tokenStart, pos + 1 - tokenStart, "static") == 0)
+                decl.staticPos = tokenStart;
+            else if (m_output.compare(tokenStart, pos + 1 - tokenStart, "const") == 0)
+                isConst = true;
+
+            atLineStart = false;
+        }
+        else if (!IsWhitespace(c))
+        {
+            return false;
+        }
+    }
+
+    return decl.start != std::string::npos && isConst;
 }
 
-// Reports a diagnostic message.
-void CFile::ReportDiagnostic(const char* type, const char* format, std::va_list args)
+// Replaces the array definition with an extern declaration of a symbol
+// that is defined by ".incbin" directives in a file-scope asm statement.
+// The element type (and thus signedness) of the declaration is kept as is.
+void CFile::OutputIncbinAsm(const IncbinDeclaration& decl, const std::vector<std::string>& paths, int size)
+{
+    long totalSize = 0;
+
+    for (const std::string& path : paths)
+    {
+        long fileSize = GetFileSize(path);
+
+        if ((fileSize % size) != 0)
+            RaiseError("Size %d doesn't evenly divide file size %ld.\n", size, fileSize);
+
+        totalSize += fileSize;
+    }
+
+    std::string output = m_output.substr(0, decl.start);
+
+    output += "asm(\".pushsection .rodata\\n.align 2\\n";
+    if (decl.staticPos == std::string::npos)
+        output += ".global " + decl.name + "\\n";
+    output += decl.name + ":\\n";
+    for (const std::string& path : paths)
+        output += ".incbin \\\"" + path + "\\\"\\n";
+    output += ".popsection\"); ";
+
+    if (decl.staticPos == std::string::npos)
+    {
+        output += "extern ";
+        output.append(m_output, decl.start, decl.bracketPos - decl.start);
+    }
+    else
+    {
+        output.append(m_output, decl.start, decl.staticPos - decl.start);
+        output += "extern";
+        output.append(m_output, decl.staticPos + 6, decl.bracketPos - decl.staticPos - 6);
+    }
+
+    output += "[" + std::to_string(totalSize / size) + "]";
+
+    // Keep the newlines between the brackets and the end of the INCBIN so that line numbers stay correct.
+    for (std::size_t pos = decl.bracketPos; pos < m_output.size(); pos++)
+        if (m_output[pos] == '\n')
+            output += '\n';
+
+    m_output = std::move(output);
+}
+
+// Formats a diagnostic message.
+std::string CFile::FormatDiagnostic(const char* type, const char* format, std::va_list args)
 {
     const int bufferSize = 1024;
     char buffer[bufferSize];
     std::vsnprintf(buffer, bufferSize, format, args);
-    std::fprintf(stderr, "%s:%ld: %s: %s\n", m_filename.c_str(), m_lineNum, type, buffer);
+    return m_filename + ":" + std::to_string(m_lineNum) + ": " + type + ": " + buffer + "\n";
 }
 
-#define DO_REPORT(type)                   \
-do                                        \
-{                                         \
-    std::va_list args;                    \
-    va_start(args, format);               \
-    ReportDiagnostic(type, format, args); \
-    va_end(args);                         \
+#define FORMAT_DIAGNOSTIC(type, message)              \
+do                                                    \
+{                                                     \
+    std::va_list args;                                \
+    va_start(args, format);                           \
+    message = FormatDiagnostic(type, format, args);   \
+    va_end(args);                                     \
 } while (0)
 
-// Reports an error diagnostic and terminates the program.
+void CFile::OutputChar(char c)
+{
+    m_output += c;
+}
+
+void CFile::OutputFormat(const char* format, ...)
+{
+    const int bufferSize = 64;
+    char buffer[bufferSize];
+
+    std::va_list args;
+    va_start(args, format);
+    std::vsnprintf(buffer, bufferSize, format, args);
+    va_end(args);
+
+    m_output += buffer;
+}
+
+// Reports an error diagnostic and stops preprocessing.
 void CFile::RaiseError(const char* format, ...)
 {
-    DO_REPORT("error");
-    std::exit(1);
+    std::string message;
+    FORMAT_DIAGNOSTIC("error", message);
+    throw PreprocError{ message };
 }
 
 // Reports a warning diagnostic.
 void CFile::RaiseWarning(const char* format, ...)
 {
-    DO_REPORT("warning");
+    std::string message;
+    FORMAT_DIAGNOSTIC("warning", message);
+    std::fputs(message.c_str(), stderr);
 }
@@ -25,34 +25,56 @@
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <vector>
 #include "preproc.h"
 
+// The array declaration an INCBIN initializer belongs to,
+// as found in the output emitted so far.
+struct IncbinDeclaration
+{
+    std::size_t start;
+    std::size_t staticPos;
+    std::size_t bracketPos;
+    std::string name;
+};
+
 class CFile
 {
 public:
-    CFile(const char * filenameCStr, bool isStdin);
+    CFile(const char * filenameCStr, bool isStdin, bool incbinAsm);
     CFile(CFile&& other);
     CFile(const CFile&) = delete;
     ~CFile();
-    void Preproc();
+    void Preproc(std::string& output);
 
 private:
     char* m_buffer;
     long m_pos;
     long m_size;
     long m_lineNum;
+    long m_braceDepth;
     std::string m_filename;
     bool m_isStdin;
+    bool m_incbinAsm;
+    std::string m_output;
 
     bool ConsumeHorizontalWhitespace();
     bool ConsumeNewline();
     void SkipWhitespace();
     void TryConvertString();
     std::unique_ptr<unsigned char[]> ReadWholeFile(const std::string& path, int& size);
+    long GetFileSize(const std::string& path);
     bool CheckIdentifier(const std::string& ident);
     void TryConvertIncbin();
-    void ReportDiagnostic(const char* type, const char* format, std::va_list args);
-    void RaiseError(const char* format, ...);
+    std::vector<std::string> ReadIncbinPaths();
+    const std::string& GetIncbinLiterals(const std::string& path, int size, bool isSigned);
+    void OutputIncbinLiterals(const std::vector<std::string>& paths, int size, bool isSigned);
+    bool FindIncbinDeclaration(IncbinDeclaration& decl);
+    void OutputIncbinAsm(const IncbinDeclaration& decl, const std::vector<std::string>& paths, int size);
+    void OutputChar(char c);
+    void OutputFormat(const char* format, ...);
+    std::string FormatDiagnostic(const char* type, const char* format, std::va_list args);
+    [[noreturn]] void RaiseError(const char* format, ...);
     void RaiseWarning(const char* format, ...);
 };
 
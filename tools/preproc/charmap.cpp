@@ -21,10 +21,14 @@
 #include <cstdio>
 #include <cstdint>
 #include <cstdarg>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
 #include "preproc.h"
 #include "charmap.h"
 #include "char_util.h"
 #include "utf8.h"
+#include "profile.h"
 
 enum LhsType
 {
@@ -96,6 +100,9 @@ CharmapReader::CharmapReader(std::string filename) : m_filename(filename)
 
     std::fclose(fp);
 
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_READ, m_size);
+
     m_pos = 0;
     m_lineNum = 1;
 
@@ -375,16 +382,31 @@ void CharmapReader::SkipWhitespace()
         m_pos++;
 }
 
-Charmap::Charmap(std::string filename)
+static const char kCompiledCharmapMagic[8] = { 'P', 'R', 'E', 'P', 'C', 'M', 'A', 'P' };
+
+Charmap::Charmap(std::string filename, std::string compiledFilename)
 {
+    long sourceSize = -1;
+    long sourceMtime = 0;
+    long readTime = static_cast<long>(std::time(nullptr));
+
+    if (!filename.empty() && !GetFileInfo(filename, sourceSize, sourceMtime))
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", filename.c_str());
+
+    if (!compiledFilename.empty() && LoadCompiled(compiledFilename, sourceSize, sourceMtime))
+        return;
+
     CharmapReader reader(filename);
+    std::map<std::int32_t, std::string> chars;
+    std::string escapes[128];
+    std::map<std::string, std::string> constants;
 
     for (;;)
     {
         Lhs lhs = reader.ReadLhs();
 
         if (lhs.type == LhsType::None)
-            return;
+            break;
 
         reader.ExpectEqualsSign();
 
@@ -393,22 +415,386 @@ Charmap::Charmap(std::string filename)
         switch (lhs.type)
         {
         case LhsType::Char:
-            if (m_chars.find(lhs.code) != m_chars.end())
+            if (chars.find(lhs.code) != chars.end())
                 reader.RaiseError("redefining char");
-            m_chars[lhs.code] = sequence;
+            chars[lhs.code] = sequence;
             break;
         case LhsType::Escape:
-            if (m_escapes[lhs.code].length() != 0)
+            if (escapes[lhs.code].length() != 0)
                 reader.RaiseError("redefining escape");
-            m_escapes[lhs.code] = sequence;
+            escapes[lhs.code] = sequence;
             break;
         case LhsType::Constant:
-            if (m_constants.find(lhs.name) != m_constants.end())
+            if (constants.find(lhs.name) != constants.end())
                 reader.RaiseError("redefining constant");
-            m_constants[lhs.name] = sequence;
+            constants[lhs.name] = sequence;
             break;
         }
 
         reader.ExpectEmptyRestOfLine();
     }
+
+    // A charmap modified in the same second it's read could change again without its mtime
+    // moving, so an image compiled from it is marked as never matching the text file.
+    if (sourceMtime >= readTime)
+        sourceSize = -1;
+
+    Compile(chars, escapes, constants, sourceSize, sourceMtime);
+}
+
+// Maps a compiled charmap.
+// Returns false if it doesn't exist, is invalid, or was compiled from a different version of the text file.
+bool Charmap::LoadCompiled(const std::string& compiledFilename, long sourceSize, long sourceMtime)
+{
+    std::unique_ptr<MappedFile> mapping(new MappedFile(compiledFilename));
+
+    if (!mapping->IsOpen() || !Attach(mapping->Data(), mapping->Size()))
+        return false;
+
+    if (m_header->sourceSize != sourceSize || m_header->sourceMtime != sourceMtime)
+        return false;
+
+    m_mapping = std::move(mapping);
+
+    return true;
+}
+
+static bool IsValidSequence(std::uint32_t packed, std::uint32_t dataSize)
+{
+    return (packed >> 5) + (packed & 0x1F) <= dataSize;
+}
+
+// Points the tables at a compiled image after checking that it's well-formed.
+bool Charmap::Attach(const unsigned char* image, std::size_t size)
+{
+    if (size < sizeof(CompiledCharmapHeader))
+        return false;
+
+    const CompiledCharmapHeader* header = reinterpret_cast<const CompiledCharmapHeader*>(image);
+
+    if (std::memcmp(header->magic, kCompiledCharmapMagic, sizeof(header->magic)) != 0
+        || header->version != kCompiledCharmapVersion
+        || header->byteOrder != 0x01020304)
+        return false;
+
+    std::uint64_t expectedSize = sizeof(CompiledCharmapHeader)
+        + 256 * sizeof(std::uint16_t)
+        + 128 * sizeof(std::uint32_t)
+        + static_cast<std::uint64_t>(header->numPages) * 256 * sizeof(std::uint32_t)
+        + static_cast<std::uint64_t>(header->numNonBmpChars) * sizeof(NonBmpEntry)
+        + static_cast<std::uint64_t>(header->numDisplacements) * sizeof(std::uint32_t)
+        + static_cast<std::uint64_t>(header->numConstantSlots) * sizeof(ConstantSlot)
+        + header->dataSize;
+
+    if (expectedSize != size || header->numPages == 0)
+        return false;
+
+    if ((header->numDisplacements == 0) != (header->numConstantSlots == 0)
+        || (header->numConstantSlots & (header->numConstantSlots - 1)) != 0)
+        return false;
+
+    const unsigned char* pos = image + sizeof(CompiledCharmapHeader);
+    const std::uint16_t* pageIndex = reinterpret_cast<const std::uint16_t*>(pos);
+    pos += 256 * sizeof(std::uint16_t);
+    const std::uint32_t* escapes = reinterpret_cast<const std::uint32_t*>(pos);
+    pos += 128 * sizeof(std::uint32_t);
+    const std::uint32_t* pages = reinterpret_cast<const std::uint32_t*>(pos);
+    pos += header->numPages * 256 * sizeof(std::uint32_t);
+    const NonBmpEntry* nonBmpChars = reinterpret_cast<const NonBmpEntry*>(pos);
+    pos += header->numNonBmpChars * sizeof(NonBmpEntry);
+    const std::uint32_t* displacements = reinterpret_cast<const std::uint32_t*>(pos);
+    pos += header->numDisplacements * sizeof(std::uint32_t);
+    const ConstantSlot* constantSlots = reinterpret_cast<const ConstantSlot*>(pos);
+    pos += header->numConstantSlots * sizeof(ConstantSlot);
+
+    for (int i = 0; i < 256; i++)
+        if (pageIndex[i] >= header->numPages)
+            return false;
+
+    for (int i = 0; i < 128; i++)
+        if (!IsValidSequence(escapes[i], header->dataSize))
+            return false;
+
+    for (std::uint32_t i = 0; i < header->numPages * 256; i++)
+        if (!IsValidSequence(pages[i], header->dataSize))
+            return false;
+
+    for (std::uint32_t i = 0; i < header->numNonBmpChars; i++)
+        if (!IsValidSequence(nonBmpChars[i].sequence, header->dataSize))
+            return false;
+
+    for (std::uint32_t i = 0; i < header->numConstantSlots; i++)
+        if (!IsValidSequence(constantSlots[i].sequence, header->dataSize)
+            || static_cast<std::uint64_t>(constantSlots[i].nameOffset) + constantSlots[i].nameLength > header->dataSize)
+            return false;
+
+    m_header = header;
+    m_pageIndex = pageIndex;
+    m_escapes = escapes;
+    m_pages = pages;
+    m_nonBmpChars = nonBmpChars;
+    m_displacements = displacements;
+    m_constantSlots = constantSlots;
+    m_data = pos;
+
+    return true;
+}
+
+bool Charmap::WriteCompiled(std::string filename) const
+{
+    std::size_t size = m_mapping ? m_mapping->Size() : static_cast<std::size_t>(m_data - reinterpret_cast<const unsigned char*>(m_header)) + m_header->dataSize;
+    FILE* fp = std::fopen(filename.c_str(), "wb");
+
+    if (fp == nullptr)
+        return false;
+
+    bool ok = std::fwrite(m_header, 1, size, fp) == size;
+
+    return (std::fclose(fp) == 0) && ok;
+}
+
+CharmapSequence Charmap::NonBmpChar(std::int32_t code) const
+{
+    const NonBmpEntry* end = m_nonBmpChars + m_header->numNonBmpChars;
+    const NonBmpEntry* it = std::lower_bound(m_nonBmpChars, end, code, [](const NonBmpEntry& entry, std::int32_t c) {
+        return entry.code < c;
+    });
+
+    if (it == end || it->code != code)
+        return MakeSequence(0);
+
+    return MakeSequence(it->sequence);
+}
+
+static std::uint32_t HashConstant(const char* name, int length, std::uint32_t seed)
+{
+    std::uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+
+    for (int i = 0; i < length; i++)
+    {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 16777619u;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+
+    return hash;
+}
+
+// Appends bytes to the data block and returns their packed sequence.
+static std::uint32_t AddData(std::string& data, const std::string& bytes)
+{
+    std::uint32_t packed = (static_cast<std::uint32_t>(data.size()) << 5) | static_cast<std::uint32_t>(bytes.size());
+    data += bytes;
+    return packed;
+}
+
+template <typename T>
+static void AppendTable(std::string& image, const T* table, std::size_t count)
+{
+    image.append(reinterpret_cast<const char*>(table), count * sizeof(T));
+}
+
+// Builds the tables and lays them out the same way as a compiled charmap file.
+void Charmap::Compile(const std::map<std::int32_t, std::string>& chars, const std::string* escapes, const std::map<std::string, std::string>& constants, long sourceSize, long sourceMtime)
+{
+    std::string data;
+    std::uint16_t pageIndex[256] = {};
+    std::uint32_t escapeTable[128];
+    // Page 0 is always empty, so that unmapped pages need no storage.
+    std::vector<std::uint32_t> pages(256, 0);
+    std::vector<NonBmpEntry> nonBmpChars;
+
+    for (const auto& pair : chars)
+    {
+        std::int32_t code = pair.first;
+
+        if (code < 0 || code > 0xFFFF)
+        {
+            nonBmpChars.push_back({ code, AddData(data, pair.second) });
+            continue;
+        }
+
+        if (pageIndex[code >> 8] == 0)
+        {
+            pageIndex[code >> 8] = static_cast<std::uint16_t>(pages.size() >> 8);
+            pages.resize(pages.size() + 256, 0);
+        }
+
+        pages[(pageIndex[code >> 8] << 8) | (code & 0xFF)] = AddData(data, pair.second);
+    }
+
+    for (int i = 0; i < 128; i++)
+        escapeTable[i] = escapes[i].empty() ? 0 : AddData(data, escapes[i]);
+
+    // Builds a perfect hash of the constants using hash and displace.
+    // Constants are split into buckets by one hash, and then each bucket,
+    // largest first, is given the smallest displacement that places all of
+    // its constants in free slots.
+    std::vector<std::uint32_t> displacements;
+    std::vector<ConstantSlot> constantSlots;
+    std::size_t numSlots = 1;
+
+    while (numSlots < constants.size() + constants.size() / 4 + 1)
+        numSlots <<= 1;
+
+    while (!constants.empty())
+    {
+        std::size_t numBuckets = numSlots / 4 + 1;
+        std::vector<std::vector<const std::pair<const std::string, std::string>*>> buckets(numBuckets);
+
+        for (const auto& pair : constants)
+            buckets[HashConstant(pair.first.data(), pair.first.length(), 0) % numBuckets].push_back(&pair);
+
+        std::vector<std::size_t> order(numBuckets);
+
+        for (std::size_t i = 0; i < numBuckets; i++)
+            order[i] = i;
+
+        std::stable_sort(order.begin(), order.end(), [&buckets](std::size_t a, std::size_t b) {
+            return buckets[a].size() > buckets[b].size();
+        });
+
+        std::vector<const std::pair<const std::string, std::string>*> slotConstants(numSlots, nullptr);
+        bool failed = false;
+
+        displacements.assign(numBuckets, 0);
+
+        for (std::size_t bucketIndex : order)
+        {
+            const auto& bucket = buckets[bucketIndex];
+
+            if (bucket.empty())
+                break;
+
+            std::uint32_t displacement;
+            std::vector<std::size_t> slots;
+
+            for (displacement = 1; displacement < 0x10000; displacement++)
+            {
+                slots.clear();
+
+                for (const auto* pair : bucket)
+                {
+                    std::size_t slot = HashConstant(pair->first.data(), pair->first.length(), displacement) & (numSlots - 1);
+
+                    if (slotConstants[slot] != nullptr || std::find(slots.begin(), slots.end(), slot) != slots.end())
+                        break;
+
+                    slots.push_back(slot);
+                }
+
+                if (slots.size() == bucket.size())
+                    break;
+            }
+
+            if (slots.size() != bucket.size())
+            {
+                failed = true;
+                break;
+            }
+
+            displacements[bucketIndex] = displacement;
+
+            for (std::size_t i = 0; i < bucket.size(); i++)
+                slotConstants[slots[i]] = bucket[i];
+        }
+
+        if (!failed)
+        {
+            constantSlots.assign(numSlots, ConstantSlot{ 0, 0, 0 });
+
+            for (std::size_t i = 0; i < numSlots; i++)
+            {
+                if (slotConstants[i] != nullptr)
+                {
+                    constantSlots[i].nameOffset = static_cast<std::uint32_t>(data.size());
+                    constantSlots[i].nameLength = static_cast<std::uint32_t>(slotConstants[i]->first.length());
+                    data += slotConstants[i]->first;
+                    constantSlots[i].sequence = AddData(data, slotConstants[i]->second);
+                }
+            }
+
+            break;
+        }
+
+        // Very unlikely, but a bigger table always gets there eventually.
+        numSlots <<= 1;
+    }
+
+    CompiledCharmapHeader header;
+
+    std::memcpy(header.magic, kCompiledCharmapMagic, sizeof(header.magic));
+    header.version = kCompiledCharmapVersion;
+    header.byteOrder = 0x01020304;
+    header.sourceSize = sourceSize;
+    header.sourceMtime = sourceMtime;
+    header.numPages = static_cast<std::uint32_t>(pages.size() >> 8);
+    header.numNonBmpChars = static_cast<std::uint32_t>(nonBmpChars.size());
+    header.numDisplacements = static_cast<std::uint32_t>(displacements.size());
+    header.numConstantSlots = static_cast<std::uint32_t>(constantSlots.size());
+    header.dataSize = static_cast<std::uint32_t>(data.size());
+    header.padding = 0;
+
+    std::string image;
+
+    AppendTable(image, &header, 1);
+    AppendTable(image, pageIndex, 256);
+    AppendTable(image, escapeTable, 128);
+    AppendTable(image, pages.data(), pages.size());
+    AppendTable(image, nonBmpChars.data(), nonBmpChars.size());
+    AppendTable(image, displacements.data(), displacements.size());
+    AppendTable(image, constantSlots.data(), constantSlots.size());
+    image += data;
+
+    // Copy into 8-byte aligned storage so the tables can be used in place.
+    m_image.assign((image.size() + 7) / 8, 0);
+    std::memcpy(m_image.data(), image.data(), image.size());
+
+    if (!Attach(reinterpret_cast<const unsigned char*>(m_image.data()), image.size()))
+        FATAL_ERROR("Failed to compile charmap.\n");
+}
+
+CharmapSequence Charmap::Constant(const char* name, int length) const
+{
+    if (m_header->numDisplacements == 0)
+        return MakeSequence(0);
+
+    std::uint32_t displacement = m_displacements[HashConstant(name, length, 0) % m_header->numDisplacements];
+    const ConstantSlot& slot = m_constantSlots[HashConstant(name, length, displacement) & (m_header->numConstantSlots - 1)];
+
+    if (slot.sequence == 0 || slot.nameLength != static_cast<std::uint32_t>(length) || std::memcmp(m_data + slot.nameOffset, name, length) != 0)
+        return MakeSequence(0);
+
+    return MakeSequence(slot.sequence);
+}
+
+// Maps a run of ASCII chars into dest.
+// Returns how many chars were mapped, which is less than length
+// if a char has no mapping or dest would overflow.
+int Charmap::MapAsciiRun(const char* s, int length, unsigned char* dest, int& destLength, int destCapacity) const
+{
+    // Page 0 of the BMP holds all of ASCII.
+    const std::uint32_t* page = m_pages + (m_pageIndex[0] << 8);
+    int i;
+
+    for (i = 0; i < length; i++)
+    {
+        std::uint32_t packed = page[static_cast<unsigned char>(s[i])];
+        int sequenceLength = packed & 0x1F;
+
+        if (sequenceLength == 0 || destLength + sequenceLength > destCapacity)
+            break;
+
+        if (sequenceLength == 1)
+            dest[destLength] = m_data[packed >> 5];
+        else
+            std::memcpy(dest + destLength, m_data + (packed >> 5), sequenceLength);
+
+        destLength += sequenceLength;
+    }
+
+    return i;
 }
@@ -24,41 +24,101 @@
 #include <cstdint>
 #include <string>
 #include <map>
+#include <memory>
 #include <vector>
+#include "mapped_file.h"
 
+// A byte sequence that a char, escape or constant maps to.
+// It points into the charmap's storage, so it is never copied.
+struct CharmapSequence
+{
+    const unsigned char* data;
+    int length;
+};
+
+const std::uint32_t kCompiledCharmapVersion = 1;
+
+// Header of a compiled charmap. The tables follow it in the order
+// page index, escapes, pages, non-BMP chars, displacements, constant slots and data.
+struct CompiledCharmapHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::int64_t sourceSize;
+    std::int64_t sourceMtime;
+    std::uint32_t numPages;
+    std::uint32_t numNonBmpChars;
+    std::uint32_t numDisplacements;
+    std::uint32_t numConstantSlots;
+    std::uint32_t dataSize;
+    std::uint32_t padding;
+};
+
+// Lookups are compiled into flat tables when the charmap is loaded:
+// BMP chars go through a two-level page table, escapes through a plain array,
+// and constants through a perfect hash, so no lookup walks a tree or allocates.
+// The tables can be written to a file and later mapped back in without parsing.
 class Charmap
 {
 public:
-    Charmap(std::string filename);
+    Charmap(std::string filename, std::string compiledFilename = std::string());
+    bool WriteCompiled(std::string filename) const;
 
-    std::string Char(std::int32_t code)
+    CharmapSequence Char(std::int32_t code) const
     {
-        auto it = m_chars.find(code);
-
-        if (it == m_chars.end())
-            return std::string();
+        if (code < 0 || code > 0xFFFF)
+            return NonBmpChar(code);
 
-        return it->second;
+        return MakeSequence(m_pages[(m_pageIndex[code >> 8] << 8) | (code & 0xFF)]);
     }
 
-    std::string Escape(unsigned char code)
+    CharmapSequence Escape(unsigned char code) const
     {
-        return m_escapes[code];
+        return MakeSequence(m_escapes[code]);
     }
 
-    std::string Constant(std::string identifier)
+    CharmapSequence Constant(const char* name, int length) const;
+    int MapAsciiRun(const char* s, int length, unsigned char* dest, int& destLength, int destCapacity) const;
+
+private:
+    struct NonBmpEntry
+    {
+        std::int32_t code;
+        std::uint32_t sequence;
+    };
+
+    struct ConstantSlot
     {
-        auto it = m_constants.find(identifier);
+        std::uint32_t nameOffset;
+        std::uint32_t nameLength;
+        std::uint32_t sequence;
+    };
 
-        if (it == m_constants.end())
-            return std::string();
+    // Either the tables built from the text file or the mapped compiled file.
+    std::vector<std::uint64_t> m_image;
+    std::unique_ptr<MappedFile> m_mapping;
 
-        return it->second;
+    // Sequences are packed as (offset in m_data << 5) | length,
+    // where a length of 0 means there's no mapping.
+    const CompiledCharmapHeader* m_header;
+    const std::uint16_t* m_pageIndex;
+    const std::uint32_t* m_escapes;
+    const std::uint32_t* m_pages;
+    const NonBmpEntry* m_nonBmpChars;
+    const std::uint32_t* m_displacements;
+    const ConstantSlot* m_constantSlots;
+    const unsigned char* m_data;
+
+    CharmapSequence MakeSequence(std::uint32_t packed) const
+    {
+        return { m_data + (packed >> 5), static_cast<int>(packed & 0x1F) };
     }
-private:
-    std::map<std::int32_t, std::string> m_chars;
-    std::string m_escapes[128];
-    std::map<std::string, std::string> m_constants;
+
+    CharmapSequence NonBmpChar(std::int32_t code) const;
+    bool LoadCompiled(const std::string& compiledFilename, long sourceSize, long sourceMtime);
+    bool Attach(const unsigned char* image, std::size_t size);
+    void Compile(const std::map<std::int32_t, std::string>& chars, const std::string* escapes, const std::map<std::string, std::string>& constants, long sourceSize, long sourceMtime);
 };
 
 #endif // CHARMAP_H
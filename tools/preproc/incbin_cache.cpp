@@ -0,0 +1,145 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include "incbin_cache.h"
+#include "profile.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+void IncbinCache::SetDirectory(std::string directory)
+{
+    m_directory = directory;
+}
+
+std::string IncbinCache::MakeKeyString(const IncbinKey& key)
+{
+    char buffer[64];
+
+    std::snprintf(buffer, sizeof(buffer), "%ld %ld %c%d ", key.fileSize, key.mtime, key.isSigned ? 'S' : 'U', key.size * 8);
+
+    return std::string(buffer) + key.path;
+}
+
+// Names the disk entry after a hash of the key.
+// The key itself is stored on the first line of the entry to detect collisions.
+std::string IncbinCache::MakeDiskPath(const std::string& keyString)
+{
+    std::uint64_t hash = 0xCBF29CE484222325;
+
+    for (unsigned char c : keyString)
+    {
+        hash ^= c;
+        hash *= 0x100000001B3;
+    }
+
+    char name[32];
+
+    std::snprintf(name, sizeof(name), "/%016llx.txt", static_cast<unsigned long long>(hash));
+
+    return m_directory + name;
+}
+
+// Returns the cached text for the key or nullptr if there is none.
+const std::string* IncbinCache::Find(const IncbinKey& key)
+{
+    std::string keyString = MakeKeyString(key);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(keyString);
+
+        if (it != m_entries.end())
+            return &it->second;
+    }
+
+    if (m_directory.empty())
+        return nullptr;
+
+    FILE* fp = std::fopen(MakeDiskPath(keyString).c_str(), "rb");
+
+    if (fp == nullptr)
+        return nullptr;
+
+    std::string contents;
+    char buffer[4096];
+    std::size_t count;
+
+    while ((count = std::fread(buffer, 1, sizeof(buffer), fp)) != 0)
+        contents.append(buffer, count);
+
+    std::fclose(fp);
+
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_READ, contents.size());
+
+    std::size_t newline = contents.find('\n');
+
+    if (newline == std::string::npos || contents.compare(0, newline, keyString) != 0)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return &m_entries.emplace(keyString, contents.substr(newline + 1)).first->second;
+}
+
+// Adds text to the cache and returns the cached copy.
+// It's only written to disk if share is true.
+// Failing to write the disk entry isn't an error, since it's only an optimization.
+const std::string* IncbinCache::Insert(const IncbinKey& key, std::string text, bool share)
+{
+    std::string keyString = MakeKeyString(key);
+
+    if (share && !m_directory.empty())
+    {
+        // Write to a temporary file first so that other processes never see a partial entry.
+        std::string diskPath = MakeDiskPath(keyString);
+        std::string tempPath = diskPath + ".tmp" + std::to_string(getpid())
+            + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        FILE* fp = std::fopen(tempPath.c_str(), "wb");
+
+        if (fp != nullptr)
+        {
+            bool ok = std::fwrite(keyString.data(), 1, keyString.size(), fp) == keyString.size()
+                && std::fputc('\n', fp) != EOF
+                && std::fwrite(text.data(), 1, text.size(), fp) == text.size();
+
+            ok = (std::fclose(fp) == 0) && ok;
+
+            PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+            PROFILE_COUNT(PROFILE_BYTES_WRITTEN, keyString.size() + 1 + text.size());
+
+            if (!ok || std::rename(tempPath.c_str(), diskPath.c_str()) != 0)
+                std::remove(tempPath.c_str());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return &m_entries.emplace(keyString, std::move(text)).first->second;
+}
@@ -0,0 +1,61 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef INCBIN_CACHE_H
+#define INCBIN_CACHE_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include "mapped_file.h"
+
+// Identifies one formatting of a file's contents.
+// The file's size and modification time are part of it
+// so that entries for an old version of a file are never used.
+struct IncbinKey
+{
+    std::string path;
+    long fileSize;
+    long mtime;
+    int size;
+    bool isSigned;
+};
+
+// Caches the literal text that INCBIN_* expands to.
+// Entries are kept in memory for the rest of the process and,
+// if a directory is set, on disk so that other preproc processes can use them.
+// It's safe to use from several threads, and entries are never replaced once added.
+class IncbinCache
+{
+public:
+    void SetDirectory(std::string directory);
+    const std::string* Find(const IncbinKey& key);
+    const std::string* Insert(const IncbinKey& key, std::string text, bool share);
+
+private:
+    std::string m_directory;
+    std::map<std::string, std::string> m_entries;
+    std::mutex m_mutex;
+
+    std::string MakeKeyString(const IncbinKey& key);
+    std::string MakeDiskPath(const std::string& keyString);
+};
+
+#endif // INCBIN_CACHE_H
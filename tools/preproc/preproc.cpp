@@ -18,36 +18,70 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <atomic>
+#include <cstdarg>
 #include <string>
 #include <stack>
+#include <thread>
+#include <vector>
 #include "preproc.h"
 #include "asm_file.h"
 #include "c_file.h"
 #include "charmap.h"
+#include "profile.h"
 
-Charmap* g_charmap;
+const Charmap* g_charmap;
+IncbinCache g_incbinCache;
+SourceCache g_sourceCache;
 
-void PrintAsmBytes(unsigned char *s, int length)
+void ThrowError(const char* format, ...)
+{
+    const int bufferSize = 1024;
+    char buffer[bufferSize];
+
+    std::va_list args;
+    va_start(args, format);
+    std::vsnprintf(buffer, bufferSize, format, args);
+    va_end(args);
+
+    throw PreprocError{ buffer };
+}
+
+void PrintAsmBytes(unsigned char *s, int length, std::string& output)
 {
     if (length > 0)
     {
-        std::printf("\t.byte ");
+        char byte[8];
+
+        output += "\t.byte ";
         for (int i = 0; i < length; i++)
         {
-            std::printf("0x%02X", s[i]);
+            std::snprintf(byte, sizeof(byte), "0x%02X", s[i]);
+            output += byte;
 
             if (i < length - 1)
-                std::printf(", ");
+                output += ", ";
         }
-        std::putchar('\n');
+        output += '\n';
     }
 }
 
-void PreprocAsmFile(std::string filename)
+// An included file that is being processed.
+struct IncludeRecord
+{
+    std::string path;
+    std::size_t outputStart;
+    double startTime;
+    double loadSeconds;
+};
+
+void PreprocAsmFile(std::string filename, std::string& output)
 {
     std::stack<AsmFile> stack;
+    std::stack<IncludeRecord> includes;
+    bool timing = g_sourceCache.IsTimingEnabled();
 
-    stack.push(AsmFile(filename));
+    stack.push(AsmFile(filename, output));
 
     for (;;)
     {
@@ -57,8 +91,15 @@ void PreprocAsmFile(std::string filename)
 
             if (stack.empty())
                 return;
-            else
-                stack.top().OutputLocation();
+
+            // Remember the included file's output for the next time it's included.
+            IncludeRecord& record = includes.top();
+            g_sourceCache.StoreOutput(record.path, output.substr(record.outputStart));
+            if (timing)
+                g_sourceCache.RecordInclude(record.path, record.loadSeconds, GetSeconds() - record.startTime, false);
+            includes.pop();
+
+            stack.top().OutputLocation();
         }
 
         Directive directive = stack.top().GetDirective();
@@ -66,14 +107,32 @@ void PreprocAsmFile(std::string filename)
         switch (directive)
         {
         case Directive::Include:
-            stack.push(AsmFile(stack.top().ReadPath()));
+        {
+            std::string path = stack.top().ReadPath();
+            double startTime = timing ? GetSeconds() : 0.0;
+            std::shared_ptr<const std::string> memo = g_sourceCache.FindOutput(path);
+
+            if (memo)
+            {
+                output += *memo;
+                stack.top().OutputLocation();
+                if (timing)
+                    g_sourceCache.RecordInclude(path, 0.0, GetSeconds() - startTime, true);
+                break;
+            }
+
+            std::size_t outputStart = output.size();
+
+            stack.push(AsmFile(path, output));
+            includes.push({ path, outputStart, startTime, timing ? GetSeconds() - startTime : 0.0 });
             stack.top().OutputLocation();
             break;
+        }
         case Directive::String:
         {
             unsigned char s[kMaxStringLength];
             int length = stack.top().ReadString(s);
-            PrintAsmBytes(s, length);
+            PrintAsmBytes(s, length, output);
             break;
         }
         case Directive::Unknown:
@@ -81,14 +140,9 @@ void PreprocAsmFile(std::string filename)
             std::string globalLabel = stack.top().GetGlobalLabel();
 
             if (globalLabel.length() != 0)
-            {
-                const char *s = globalLabel.c_str();
-                std::printf("%s: ; .global %s\n", s, s);
-            }
+                output += globalLabel + ": ; .global " + globalLabel + "\n";
             else
-            {
                 stack.top().OutputLine();
-            }
 
             break;
         }
@@ -96,15 +150,15 @@ void PreprocAsmFile(std::string filename)
     }
 }
 
-void PreprocCFile(const char * filename, bool isStdin)
+void PreprocCFile(const char * filename, bool isStdin, bool incbinAsm, std::string& output)
 {
-    CFile cFile(filename, isStdin);
-    cFile.Preproc();
+    CFile cFile(filename, isStdin, incbinAsm);
+    cFile.Preproc(output);
 }
 
-char* GetFileExtension(char* filename)
+const char* GetFileExtension(const char* filename)
 {
-    char* extension = filename;
+    const char* extension = filename;
 
     while (*extension != 0)
         extension++;
@@ -123,35 +177,266 @@ char* GetFileExtension(char* filename)
     return extension;
 }
 
-int main(int argc, char **argv)
+// Preprocesses a file according to its extension and appends the result to output.
+void PreprocFile(const char* filename, bool isStdin, bool incbinAsm, std::string& output)
+{
+    ProfileScope scope("PreprocFile", filename);
+    const char* extension = GetFileExtension(filename);
+
+    if (!extension)
+        FATAL_ERROR("\"%s\" has no file extension.\n", filename);
+
+    if ((extension[0] == 's') && extension[1] == 0)
+        PreprocAsmFile(filename, output);
+    else if ((extension[0] == 'c' || extension[0] == 'i') && extension[1] == 0)
+        PreprocCFile(filename, isStdin, incbinAsm, output);
+    else
+        FATAL_ERROR("\"%s\" has an unknown file extension of \"%s\".\n", filename, extension);
+}
+
+struct Job
 {
-    if (argc < 3 || argc > 4)
+    std::string source;
+    std::string output;
+};
+
+// Reads a batch list, which has a source file and an output file on each line.
+std::vector<Job> ReadJobList(const char* filename)
+{
+    FILE* fp = std::fopen(filename, "r");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", filename);
+
+    std::vector<Job> jobs;
+    std::string line;
+    long lineNum = 0;
+    int c;
+
+    do
     {
-        std::fprintf(stderr, "Usage: %s SRC_FILE CHARMAP_FILE [-i]\nwhere -i denotes if input is from stdin\n", argv[0]);
-        return 1;
-    }
+        c = std::fgetc(fp);
 
-    g_charmap = new Charmap(argv[2]);
+        if (c != '\n' && c != EOF)
+        {
+            line += static_cast<char>(c);
+            continue;
+        }
 
-    char* extension = GetFileExtension(argv[1]);
+        lineNum++;
 
-    if (!extension)
-        FATAL_ERROR("\"%s\" has no file extension.\n", argv[1]);
+        std::vector<std::string> paths;
+        std::size_t pos = 0;
 
-    if ((extension[0] == 's') && extension[1] == 0)
-        PreprocAsmFile(argv[1]);
-    else if ((extension[0] == 'c' || extension[0] == 'i') && extension[1] == 0) {
-        if (argc == 4) {
-            if (argv[3][0] == '-' && argv[3][1] == 'i' && argv[3][2] == '\0') {
-                PreprocCFile(argv[1], true);
-            } else {
-                FATAL_ERROR("unknown argument flag \"%s\".\n", argv[3]);
+        while ((pos = line.find_first_not_of(" \t\r", pos)) != std::string::npos)
+        {
+            std::size_t end = line.find_first_of(" \t\r", pos);
+
+            if (end == std::string::npos)
+                end = line.size();
+
+            if (end - pos > static_cast<std::size_t>(kMaxPath))
+            {
+                std::fclose(fp);
+                FATAL_ERROR("%s:%ld: path is longer than %d characters.\n", filename, lineNum, kMaxPath);
+            }
+
+            paths.push_back(line.substr(pos, end - pos));
+            pos = end;
+        }
+
+        if (paths.size() == 2)
+        {
+            jobs.push_back({ paths[0], paths[1] });
+        }
+        else if (!paths.empty())
+        {
+            std::fclose(fp);
+            FATAL_ERROR("%s:%ld: expected a source file and an output file.\n", filename, lineNum);
+        }
+
+        line.clear();
+    } while (c != EOF);
+
+    std::fclose(fp);
+
+    return jobs;
+}
+
+// Preprocesses every job on a pool of threads sharing the charmap and the INCBIN cache.
+// A failed job doesn't stop the others. Its error is printed once every worker has finished,
+// and the function returns false.
+bool RunJobs(const std::vector<Job>& jobs, unsigned int numThreads, bool incbinAsm)
+{
+    std::atomic<std::size_t> nextJob(0);
+    std::vector<std::string> errors(jobs.size());
+
+    auto worker = [&]()
+    {
+        std::size_t i;
+
+        while ((i = nextJob++) < jobs.size())
+        {
+            try
+            {
+                std::string output;
+
+                PreprocFile(jobs[i].source.c_str(), false, incbinAsm, output);
+
+                FILE* fp = std::fopen(jobs[i].output.c_str(), "wb");
+
+                if (fp == NULL)
+                    FATAL_ERROR("Failed to open \"%s\" for writing.\n", jobs[i].output.c_str());
+
+                bool ok = std::fwrite(output.data(), 1, output.size(), fp) == output.size();
+
+                if (std::fclose(fp) != 0 || !ok)
+                    FATAL_ERROR("Failed to write \"%s\".\n", jobs[i].output.c_str());
+
+                PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+                PROFILE_COUNT(PROFILE_BYTES_WRITTEN, output.size());
+            }
+            catch (const PreprocError& e)
+            {
+                errors[i] = e.message;
             }
-        } else {
-            PreprocCFile(argv[1], false);
         }
-    } else
-        FATAL_ERROR("\"%s\" has an unknown file extension of \"%s\".\n", argv[1], extension);
+    };
+
+    std::vector<std::thread> threads;
+
+    for (unsigned int i = 1; i < numThreads && i < jobs.size(); i++)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    bool ok = true;
+
+    for (const std::string& error : errors)
+    {
+        if (!error.empty())
+        {
+            std::fputs(error.c_str(), stderr);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+void PrintUsage(const char* program)
+{
+    std::fprintf(stderr, "Usage: %s SRC_FILE CHARMAP_FILE [options]\n"
+                         "       %s --batch LIST_FILE CHARMAP_FILE [options] [-j JOBS]\n"
+                         "       %s --compile-charmap CHARMAP_FILE OUT_FILE\n"
+                         "LIST_FILE has a source file and an output file on each line.\n"
+                         "Options:\n"
+                         "  -i                      input is from stdin\n"
+                         "  --incbin-asm            emit INCBIN data as .incbin directives instead of C literals\n"
+                         "  --incbin-cache DIR      share formatted INCBIN data with other runs through DIR\n"
+                         "  --compiled-charmap FILE use a charmap compiled with --compile-charmap if it's up to date\n"
+                         "  --include-timing        print how long each .include took to stderr\n",
+                         program, program, program);
+}
+
+int Preproc(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    if (std::string(argv[1]) == "--compile-charmap")
+    {
+        if (argc != 4)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        Charmap charmap(argv[2]);
+
+        if (!charmap.WriteCompiled(argv[3]))
+            FATAL_ERROR("Failed to write \"%s\".\n", argv[3]);
+
+        return 0;
+    }
+
+    bool isBatch = (std::string(argv[1]) == "--batch");
+    int firstOption = isBatch ? 4 : 3;
+
+    if (argc < firstOption)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    const char* srcFile = argv[firstOption - 2];
+    const char* charmapFile = argv[firstOption - 1];
+    bool isStdin = false;
+    bool incbinAsm = false;
+    std::string compiledCharmap;
+    unsigned int numThreads = std::thread::hardware_concurrency();
+
+    for (int i = firstOption; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+
+        if (arg == "-i" && !isBatch)
+            isStdin = true;
+        else if (arg == "-j" && isBatch && i + 1 < argc)
+            numThreads = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--incbin-asm")
+            incbinAsm = true;
+        else if (arg == "--incbin-cache" && i + 1 < argc)
+            g_incbinCache.SetDirectory(argv[++i]);
+        else if (arg == "--compiled-charmap" && i + 1 < argc)
+            compiledCharmap = argv[++i];
+        else if (arg == "--include-timing")
+            g_sourceCache.EnableTiming();
+        else
+            FATAL_ERROR("unknown argument flag \"%s\".\n", argv[i]);
+    }
+
+    {
+        ProfileScope scope("LoadCharmap", charmapFile);
+        g_charmap = new Charmap(charmapFile, compiledCharmap);
+    }
+
+    if (isBatch)
+    {
+        if (!RunJobs(ReadJobList(srcFile), numThreads == 0 ? 1 : numThreads, incbinAsm))
+            return 1;
+    }
+    else
+    {
+        std::string output;
+        PreprocFile(srcFile, isStdin, incbinAsm, output);
+        std::fwrite(output.data(), 1, output.size(), stdout);
+        PROFILE_COUNT(PROFILE_BYTES_WRITTEN, output.size());
+    }
+
+    if (g_sourceCache.IsTimingEnabled())
+        g_sourceCache.PrintTimings(stderr);
 
     return 0;
 }
+
+int main(int argc, char **argv)
+{
+    ProfileInit("preproc", &argc, argv);
+
+    try
+    {
+        return Preproc(argc, argv);
+    }
+    catch (const PreprocError& e)
+    {
+        std::fputs(e.message.c_str(), stderr);
+        return 1;
+    }
+}
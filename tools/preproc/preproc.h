@@ -23,25 +23,28 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <string>
 #include "charmap.h"
+#include "incbin_cache.h"
+#include "source_cache.h"
+
+// Thrown by FATAL_ERROR and RaiseError with the message to print.
+// Errors don't exit directly, because a batch job's worker thread has to let
+// the other jobs finish with the shared caches first.
+struct PreprocError
+{
+    std::string message;
+};
+
+[[noreturn]] void ThrowError(const char* format, ...);
 
 #ifdef _MSC_VER
 
-#define FATAL_ERROR(format, ...)               \
-do                                             \
-{                                              \
-    std::fprintf(stderr, format, __VA_ARGS__); \
-    std::exit(1);                              \
-} while (0)
+#define FATAL_ERROR(format, ...) ThrowError(format, __VA_ARGS__)
 
 #else
 
-#define FATAL_ERROR(format, ...)                 \
-do                                               \
-{                                                \
-    std::fprintf(stderr, format, ##__VA_ARGS__); \
-    std::exit(1);                                \
-} while (0)
+#define FATAL_ERROR(format, ...) ThrowError(format, ##__VA_ARGS__)
 
 #endif // _MSC_VER
 
@@ -49,6 +52,9 @@ const int kMaxPath = 256;
 const int kMaxStringLength = 1024;
 const unsigned long kMaxCharmapSequenceLength = 16;
 
-extern Charmap* g_charmap;
+// Shared by every job, so it's never modified after it's loaded.
+extern const Charmap* g_charmap;
+extern IncbinCache g_incbinCache;
+extern SourceCache g_sourceCache;
 
 #endif // PREPROC_H
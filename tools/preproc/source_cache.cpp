@@ -0,0 +1,108 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "source_cache.h"
+#include "asm_scan.h"
+
+double GetSeconds()
+{
+    std::chrono::duration<double> now = std::chrono::steady_clock::now().time_since_epoch();
+    return now.count();
+}
+
+// Returns the file with its comments removed, or nullptr if it can't be read.
+std::shared_ptr<const MappedFile> SourceCache::Load(const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_files.find(path);
+
+        if (it != m_files.end())
+            return it->second;
+    }
+
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(path, kScanPadding + 1);
+
+    if (!file->IsOpen())
+        return nullptr;
+
+    RemoveAsmComments(reinterpret_cast<char*>(file->MutableData()));
+
+    // If another thread loaded it first, use its copy.
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_files.emplace(path, file).first->second;
+}
+
+// Returns the remembered output of an included file, or nullptr if it hasn't been processed yet.
+std::shared_ptr<const std::string> SourceCache::FindOutput(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_outputs.find(path);
+
+    if (it == m_outputs.end())
+        return nullptr;
+
+    return it->second;
+}
+
+void SourceCache::StoreOutput(const std::string& path, std::string output)
+{
+    std::shared_ptr<const std::string> shared = std::make_shared<const std::string>(std::move(output));
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_outputs.emplace(path, shared);
+}
+
+void SourceCache::RecordInclude(const std::string& path, double loadSeconds, double totalSeconds, bool memoHit)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    IncludeStats& stats = m_stats.emplace(path, IncludeStats{ 0, 0, 0.0, 0.0 }).first->second;
+
+    stats.count++;
+    if (memoHit)
+        stats.memoHits++;
+    stats.loadSeconds += loadSeconds;
+    stats.totalSeconds += totalSeconds;
+}
+
+// Prints the included files, slowest first.
+// The total time of a file includes the files it includes.
+void SourceCache::PrintTimings(FILE* fp)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::pair<std::string, IncludeStats>> entries(m_stats.begin(), m_stats.end());
+
+    std::sort(entries.begin(), entries.end(), [](const std::pair<std::string, IncludeStats>& a, const std::pair<std::string, IncludeStats>& b) {
+        return a.second.totalSeconds > b.second.totalSeconds;
+    });
+
+    std::fprintf(fp, "%8s %8s %10s %10s  %s\n", "includes", "memoized", "load ms", "total ms", "file");
+
+    for (const auto& entry : entries)
+    {
+        const IncludeStats& stats = entry.second;
+        std::fprintf(fp, "%8ld %8ld %10.3f %10.3f  %s\n", stats.count, stats.memoHits,
+            stats.loadSeconds * 1000.0, stats.totalSeconds * 1000.0, entry.first.c_str());
+    }
+}
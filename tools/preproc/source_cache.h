@@ -0,0 +1,66 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef SOURCE_CACHE_H
+#define SOURCE_CACHE_H
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "mapped_file.h"
+
+// Per-file statistics for --include-timing.
+struct IncludeStats
+{
+    long count;
+    long memoHits;
+    double loadSeconds;
+    double totalSeconds;
+};
+
+// Shares assembly files between every AsmFile in the process.
+// Each file is loaded and has its comments removed once, and the output
+// of each included file is remembered so that including it again is
+// just a copy. It's safe to use from several threads.
+class SourceCache
+{
+public:
+    SourceCache() : m_timingEnabled(false) {}
+    std::shared_ptr<const MappedFile> Load(const std::string& path);
+    std::shared_ptr<const std::string> FindOutput(const std::string& path);
+    void StoreOutput(const std::string& path, std::string output);
+    void EnableTiming() { m_timingEnabled = true; }
+    bool IsTimingEnabled() const { return m_timingEnabled; }
+    void RecordInclude(const std::string& path, double loadSeconds, double totalSeconds, bool memoHit);
+    void PrintTimings(FILE* fp);
+
+private:
+    std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<const MappedFile>> m_files;
+    std::map<std::string, std::shared_ptr<const std::string>> m_outputs;
+    std::map<std::string, IncludeStats> m_stats;
+    bool m_timingEnabled;
+};
+
+double GetSeconds();
+
+#endif // SOURCE_CACHE_H
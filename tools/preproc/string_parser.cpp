@@ -20,16 +20,21 @@
 
 #include <cstdio>
 #include <cstdarg>
+#include <cstring>
 #include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "preproc.h"
 #include "string_parser.h"
 #include "char_util.h"
 #include "utf8.h"
+#include "asm_scan.h"
 
 // Reads a charmap char or escape sequence.
-std::string StringParser::ReadCharOrEscape()
+CharmapSequence StringParser::ReadCharOrEscape()
 {
-    std::string sequence;
+    CharmapSequence sequence;
 
     bool isEscape = (m_buffer[m_pos] == '\\');
 
@@ -41,7 +46,7 @@ std::string StringParser::ReadCharOrEscape()
         {
             sequence = g_charmap->Char('"');
 
-            if (sequence.length() == 0)
+            if (sequence.length == 0)
                 RaiseError("no mapping exists for double quote");
 
             return sequence;
@@ -50,7 +55,7 @@ std::string StringParser::ReadCharOrEscape()
         {
             sequence = g_charmap->Char('\\');
 
-            if (sequence.length() == 0)
+            if (sequence.length == 0)
                 RaiseError("no mapping exists for backslash");
 
             return sequence;
@@ -82,7 +87,7 @@ std::string StringParser::ReadCharOrEscape()
 
     sequence = isEscape ? g_charmap->Escape(code) : g_charmap->Char(code);
 
-    if (sequence.length() == 0)
+    if (sequence.length == 0)
     {
         if (isEscape)
             RaiseError("unknown escape '\\%c'", code);
@@ -94,10 +99,8 @@ std::string StringParser::ReadCharOrEscape()
 }
 
 // Reads a charmap constant, i.e. "{FOO}".
-std::string StringParser::ReadBracketedConstants()
+void StringParser::ReadBracketedConstants()
 {
-    std::string totalSequence;
-
     m_pos++; // Assume we're on the left curly bracket.
 
     while (m_buffer[m_pos] != '}')
@@ -113,15 +116,15 @@ std::string StringParser::ReadBracketedConstants()
             while (IsIdentifierChar(m_buffer[m_pos]))
                 m_pos++;
 
-            std::string sequence = g_charmap->Constant(std::string(&m_buffer[startPos], m_pos - startPos));
+            CharmapSequence sequence = g_charmap->Constant(&m_buffer[startPos], m_pos - startPos);
 
-            if (sequence.length() == 0)
+            if (sequence.length == 0)
             {
-                m_buffer[m_pos] = 0;
-                RaiseError("unknown constant '%s'", &m_buffer[startPos]);
+                std::string name(&m_buffer[startPos], m_pos - startPos);
+                RaiseError("unknown constant '%s'", name.c_str());
             }
 
-            totalSequence += sequence;
+            AppendSequence(sequence);
         }
         else if (IsAsciiDigit(m_buffer[m_pos]))
         {
@@ -130,17 +133,17 @@ std::string StringParser::ReadBracketedConstants()
             switch (integer.size)
             {
             case 1:
-                totalSequence += (unsigned char)integer.value;
+                AppendByte((unsigned char)integer.value);
                 break;
             case 2:
-                totalSequence += (unsigned char)integer.value;
-                totalSequence += (unsigned char)(integer.value >> 8);
+                AppendByte((unsigned char)integer.value);
+                AppendByte((unsigned char)(integer.value >> 8));
                 break;
             case 4:
-                totalSequence += (unsigned char)integer.value;
-                totalSequence += (unsigned char)(integer.value >> 8);
-                totalSequence += (unsigned char)(integer.value >> 16);
-                totalSequence += (unsigned char)(integer.value >> 24);
+                AppendByte((unsigned char)integer.value);
+                AppendByte((unsigned char)(integer.value >> 8));
+                AppendByte((unsigned char)(integer.value >> 16));
+                AppendByte((unsigned char)(integer.value >> 24));
                 break;
             }
         }
@@ -161,8 +164,106 @@ std::string StringParser::ReadBracketedConstants()
     }
 
     m_pos++; // Go past the right curly bracket.
+}
+
+void StringParser::AppendByte(unsigned char c)
+{
+    if (m_destLength == kMaxStringLength)
+        RaiseError("mapped string longer than %d bytes", kMaxStringLength);
+
+    m_dest[m_destLength++] = c;
+}
+
+void StringParser::AppendSequence(CharmapSequence sequence)
+{
+    if (m_destLength + sequence.length > kMaxStringLength)
+        RaiseError("mapped string longer than %d bytes", kMaxStringLength);
+
+    std::memcpy(m_dest + m_destLength, sequence.data, sequence.length);
+    m_destLength += sequence.length;
+}
+
+// Returns how many bytes at s are printable ASCII chars that map directly,
+// i.e. anything but quotes, backslashes and left curly brackets.
+// With SSE2, 16 bytes are classified at a time, so the buffer must have
+// kScanPadding readable bytes after its null terminator.
+static int CountPlainAscii(const char* s)
+{
+    int count = 0;
+
+#ifdef __SSE2__
+    const __m128i belowSpace = _mm_set1_epi8(' ' - 1);
+    const __m128i aboveTilde = _mm_set1_epi8('~' + 1);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i leftCurly = _mm_set1_epi8('{');
+
+    for (;;)
+    {
+        // Bytes 0x80 and up are negative as signed chars, so they fail the range check.
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + count));
+        __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(chunk, belowSpace), _mm_cmplt_epi8(chunk, aboveTilde));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)), _mm_cmpeq_epi8(chunk, leftCurly));
+        int mask = _mm_movemask_epi8(_mm_andnot_si128(special, printable));
+
+        if (mask != 0xFFFF)
+            return count + __builtin_ctz(~mask);
+
+        count += 16;
+    }
+#else
+    for (;;)
+    {
+        unsigned char c = s[count];
+
+        if (!IsAsciiPrintable(c) || c == '"' || c == '\\' || c == '{')
+            return count;
+
+        count++;
+    }
+#endif // __SSE2__
+}
+
+// Maps as many chars as possible without going through ReadCharOrEscape.
+// Anything unusual, including every error, is left for the slow path so
+// that diagnostics stay the same.
+void StringParser::ReadPlainChars()
+{
+    for (;;)
+    {
+        int asciiLength = CountPlainAscii(&m_buffer[m_pos]);
+
+        if (asciiLength > 0)
+        {
+            int mapped = g_charmap->MapAsciiRun(&m_buffer[m_pos], asciiLength, m_dest, m_destLength, kMaxStringLength);
+
+            m_pos += mapped;
+
+            if (mapped < asciiLength)
+                return;
+        }
+
+        if (!(static_cast<unsigned char>(m_buffer[m_pos]) & 0x80))
+            return;
+
+        // Runs of non-ASCII chars, which the table-driven decoder validates as it goes.
+        while (static_cast<unsigned char>(m_buffer[m_pos]) & 0x80)
+        {
+            UnicodeChar unicodeChar = DecodeUtf8(&m_buffer[m_pos]);
+
+            if (unicodeChar.code == -1)
+                return;
+
+            CharmapSequence sequence = g_charmap->Char(unicodeChar.code);
 
-    return totalSequence;
+            if (sequence.length == 0 || m_destLength + sequence.length > kMaxStringLength)
+                return;
+
+            std::memcpy(m_dest + m_destLength, sequence.data, sequence.length);
+            m_destLength += sequence.length;
+            m_pos += unicodeChar.encodingLength;
+        }
+    }
 }
 
 // Reads a charmap string.
@@ -177,23 +278,26 @@ int StringParser::ParseString(long srcPos, unsigned char* dest, int& destLength)
 
     m_pos++;
 
-    destLength = 0;
+    m_dest = dest;
+    m_destLength = 0;
 
-    while (m_buffer[m_pos] != '"')
+    for (;;)
     {
-        std::string sequence = (m_buffer[m_pos] == '{') ? ReadBracketedConstants() : ReadCharOrEscape();
+        ReadPlainChars();
 
-        for (const char& c : sequence)
-        {
-            if (destLength == kMaxStringLength)
-                RaiseError("mapped string longer than %d bytes", kMaxStringLength);
+        if (m_buffer[m_pos] == '"')
+            break;
 
-            dest[destLength++] = c;
-        }
+        if (m_buffer[m_pos] == '{')
+            ReadBracketedConstants();
+        else
+            AppendSequence(ReadCharOrEscape());
     }
 
     m_pos++; // Go past the right quote.
 
+    destLength = m_destLength;
+
     return m_pos - start;
 }
 
@@ -25,10 +25,11 @@
 #include <string>
 #include "preproc.h"
 
+// Parses string literals. The buffer must be padded like the ones FindAny scans.
 class StringParser
 {
 public:
-    StringParser(char* buffer, long size) : m_buffer(buffer), m_size(size), m_pos(0) {}
+    StringParser(const char* buffer, long size) : m_buffer(buffer), m_size(size), m_pos(0), m_dest(nullptr), m_destLength(0) {}
     int ParseString(long srcPos, unsigned char* dest, int &destLength);
 
 private:
@@ -38,15 +39,20 @@ private:
         int size;
     };
 
-    char* m_buffer;
+    const char* m_buffer;
     long m_size;
     long m_pos;
+    unsigned char* m_dest;
+    int m_destLength;
 
     Integer ReadInteger();
     Integer ReadDecimal();
     Integer ReadHex();
-    std::string ReadCharOrEscape();
-    std::string ReadBracketedConstants();
+    void ReadPlainChars();
+    CharmapSequence ReadCharOrEscape();
+    void ReadBracketedConstants();
+    void AppendByte(unsigned char c);
+    void AppendSequence(CharmapSequence sequence);
     void SkipWhitespace();
     void SkipRestOfInteger(int radix);
     void RaiseError(const char* format, ...);
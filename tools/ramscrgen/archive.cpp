@@ -0,0 +1,157 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstdlib>
+#include <cstring>
+#include "ramscrgen.h"
+#include "archive.h"
+
+static const std::size_t kMemberHeaderSize = 60;
+
+// Reads a decimal field of a member header, which is padded with spaces.
+static std::size_t ReadDecimal(const unsigned char* field, int length)
+{
+    char buffer[17] = {0};
+    std::memcpy(buffer, field, length);
+    return std::strtoul(buffer, nullptr, 10);
+}
+
+Archive::Archive(const std::string& path) : m_path(path), m_file(path)
+{
+    char expectedMagic[8] = {'!', '<', 'a', 'r', 'c', 'h', '>', '\n'};
+    char expectedEndMagic[2] = { 0x60, 0x0a };
+
+    if (!m_file.IsOpen())
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
+
+    const unsigned char* data = m_file.Data();
+    std::size_t size = m_file.Size();
+
+    if (size < 8)
+        FATAL_ERROR("error: failed to read AR magic from \"%s\"\n", path.c_str());
+
+    if (std::memcmp(data, expectedMagic, 8) != 0)
+        FATAL_ERROR("error: AR magic did not match in \"%s\"\n", path.c_str());
+
+    const char* longNames = nullptr;
+    std::size_t longNamesSize = 0;
+    std::size_t pos = 8;
+
+    while (pos < size)
+    {
+        const unsigned char* header = data + pos;
+        char ident[17] = {0};
+
+        if (size - pos < kMemberHeaderSize)
+            FATAL_ERROR("error: failed to read file ident in \"%s\"\n", path.c_str());
+
+        std::memcpy(ident, header, 16);
+
+        if (std::memcmp(header + 58, expectedEndMagic, 2) != 0)
+            FATAL_ERROR("error: corrupted archive header in \"%s\" at \"%s\"\n", path.c_str(), ident);
+
+        std::size_t memberSize = ReadDecimal(header + 48, 10);
+        pos += kMemberHeaderSize;
+
+        if (memberSize > size - pos)
+            FATAL_ERROR("error: member \"%s\" runs past the end of \"%s\"\n", ident, path.c_str());
+
+        const unsigned char* memberData = data + pos;
+        std::string name;
+
+        // Members start on even offsets.
+        std::size_t next = pos + memberSize + (memberSize & 1);
+
+        if (ident[0] == '/' && ident[1] == ' ')
+        {
+            // The symbol table.
+        }
+        else if (std::strncmp(ident, "/SYM64/", 7) == 0)
+        {
+            // The 64-bit symbol table.
+        }
+        else if (ident[0] == '/' && ident[1] == '/')
+        {
+            longNames = reinterpret_cast<const char*>(memberData);
+            longNamesSize = memberSize;
+        }
+        else if (ident[0] == '/' && ident[1] >= '0' && ident[1] <= '9')
+        {
+            // A GNU long name, which ends with "/\n" in the long name table.
+            std::size_t offset = std::strtoul(ident + 1, nullptr, 10);
+
+            if (longNames == nullptr || offset >= longNamesSize)
+                FATAL_ERROR("error: bad long name \"%s\" in \"%s\"\n", ident, path.c_str());
+
+            std::size_t end = offset;
+
+            while (end < longNamesSize && longNames[end] != '\n')
+                end++;
+
+            if (end > offset && longNames[end - 1] == '/')
+                end--;
+
+            name.assign(longNames + offset, end - offset);
+        }
+        else if (std::strncmp(ident, "#1/", 3) == 0)
+        {
+            // A BSD long name, which is at the start of the member's data.
+            std::size_t nameLength = std::strtoul(ident + 3, nullptr, 10);
+
+            if (nameLength > memberSize)
+                FATAL_ERROR("error: bad long name \"%s\" in \"%s\"\n", ident, path.c_str());
+
+            name.assign(reinterpret_cast<const char*>(memberData), nameLength);
+            name = name.substr(0, name.find('\0'));
+            memberData += nameLength;
+            memberSize -= nameLength;
+        }
+        else
+        {
+            // A short name, which ends with "/" in GNU archives and is padded with spaces.
+            char* end = std::strchr(ident, '/');
+
+            if (end == nullptr)
+                end = ident + std::strlen(ident);
+
+            while (end > ident && end[-1] == ' ')
+                end--;
+
+            name.assign(ident, end - ident);
+        }
+
+        // Keep the first member with a name, like the linear search did.
+        if (!name.empty())
+            m_members.insert({ name, { memberData, static_cast<std::uint32_t>(memberSize) } });
+
+        pos = next;
+    }
+}
+
+bool Archive::FindMember(const std::string& name, ArchiveMember& member) const
+{
+    auto it = m_members.find(name);
+
+    if (it == m_members.end())
+        return false;
+
+    member = it->second;
+    return true;
+}
@@ -0,0 +1,55 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "mapped_file.h"
+
+// The contents of one archive member.
+struct ArchiveMember
+{
+    const unsigned char* data;
+    std::uint32_t size;
+};
+
+// An "!<arch>" archive with an index of its members, built by reading every
+// member header once. GNU long names from the "//" table and BSD "#1/" names
+// are supported, and the "/" symbol table is skipped.
+class Archive
+{
+public:
+    Archive(const std::string& path);
+    Archive(const Archive&) = delete;
+    Archive& operator=(const Archive&) = delete;
+    bool FindMember(const std::string& name, ArchiveMember& member) const;
+    const std::string& GetPath() const { return m_path; }
+
+private:
+    std::string m_path;
+    MappedFile m_file;
+    std::unordered_map<std::string, ArchiveMember> m_members;
+};
+
+#endif // ARCHIVE_H
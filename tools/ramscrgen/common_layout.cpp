@@ -0,0 +1,140 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "common_layout.h"
+
+// The alignment the linker script gives a common symbol of a given size.
+unsigned long GetCommonAlignment(unsigned long size)
+{
+    if (size > 8)
+        return 16;
+    if (size > 4)
+        return 8;
+    return 4;
+}
+
+static unsigned long AlignUp(unsigned long offset, unsigned long alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+static unsigned long LayOut(const std::vector<CommonEntry>& entries, std::size_t begin, std::size_t end, unsigned long offset)
+{
+    for (std::size_t i = begin; i < end; i++)
+        offset = AlignUp(offset, entries[i].alignment) + entries[i].size;
+
+    return offset;
+}
+
+// Returns how many bytes the entries take when laid out in order from base.
+unsigned long GetLayoutSize(const std::vector<CommonEntry>& entries, unsigned long base)
+{
+    return LayOut(entries, 0, entries.size(), base) - base;
+}
+
+// Orders the symbols between begin and end by always placing next whichever
+// one needs the least padding. Ties go to the larger alignment, then the
+// larger size, then the earlier symbol, so the result only depends on the input.
+static void PackRun(std::vector<CommonEntry>& entries, std::size_t begin, std::size_t end, unsigned long offset)
+{
+    for (std::size_t i = begin; i < end; i++)
+    {
+        std::size_t best = i;
+        unsigned long bestPadding = AlignUp(offset, entries[i].alignment) - offset;
+
+        for (std::size_t j = i + 1; j < end; j++)
+        {
+            unsigned long padding = AlignUp(offset, entries[j].alignment) - offset;
+
+            if (padding < bestPadding
+                || (padding == bestPadding && entries[j].alignment > entries[best].alignment)
+                || (padding == bestPadding && entries[j].alignment == entries[best].alignment && entries[j].size > entries[best].size))
+            {
+                best = j;
+                bestPadding = padding;
+            }
+        }
+
+        // Shift rather than swap so that equal symbols keep their order.
+        CommonEntry entry = entries[best];
+        entries.erase(entries.begin() + best);
+        entries.insert(entries.begin() + i, entry);
+
+        offset += bestPadding + entry.size;
+    }
+}
+
+// Reorders the symbols between gaps, laid out from base, using PackRun.
+static void PackFrom(std::vector<CommonEntry>& entries, unsigned long base)
+{
+    unsigned long offset = base;
+    std::size_t begin = 0;
+
+    while (begin < entries.size())
+    {
+        if (entries[begin].label.empty())
+        {
+            offset = LayOut(entries, begin, begin + 1, offset);
+            begin++;
+            continue;
+        }
+
+        std::size_t end = begin;
+
+        while (end < entries.size() && !entries[end].label.empty())
+            end++;
+
+        PackRun(entries, begin, end, offset);
+        offset = LayOut(entries, begin, end, offset);
+        begin = end;
+    }
+}
+
+// Reorders the symbols between gaps to reduce the padding that alignment adds.
+// Gaps stay where they are, since they may stand for data that is addressed
+// relative to the symbols around them. If exactBase is set, the symbols start
+// at base. Otherwise base is only known to be 4-byte aligned, so the new order
+// has to be smaller wherever in a 16-byte line it starts. The original order is
+// kept if packing doesn't make the layout smaller. Returns how many bytes were
+// saved, which is the smallest saving over the possible starts if base isn't exact.
+unsigned long PackCommonEntries(std::vector<CommonEntry>& entries, unsigned long base, bool exactBase)
+{
+    std::vector<CommonEntry> packed = entries;
+    unsigned long numStarts = exactBase ? 1 : 4;
+    unsigned long saved = 0;
+
+    PackFrom(packed, base);
+
+    for (unsigned long i = 0; i < numStarts; i++)
+    {
+        unsigned long start = base + i * 4;
+        unsigned long originalSize = GetLayoutSize(entries, start);
+        unsigned long packedSize = GetLayoutSize(packed, start);
+
+        if (packedSize >= originalSize)
+            return 0;
+
+        if (i == 0 || originalSize - packedSize < saved)
+            saved = originalSize - packedSize;
+    }
+
+    entries.swap(packed);
+    return saved;
+}
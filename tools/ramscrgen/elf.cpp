@@ -1,272 +1,227 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdint>
-#include <map>
-#include <vector>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include "ramscrgen.h"
 #include "elf.h"
+#include "archive.h"
+#include "mapped_file.h"
+#include "profile.h"
 
 #define SHN_COMMON 0xFFF2
 
-static std::string s_elfPath;
-static std::string s_archiveFilePath;
-static std::string s_archiveObjectPath;
-
-static FILE *s_file;
-
-static std::uint32_t s_sectionHeaderOffset;
-static int s_sectionHeaderEntrySize;
-static int s_sectionCount;
-static int s_shstrtabIndex;
-
-static std::uint32_t s_symtabOffset;
-static std::uint32_t s_strtabOffset;
-
-static std::uint32_t s_symbolCount;
-static std::uint32_t s_elfFileOffset;
-
-struct Symbol
+// An ELF file in memory, which may be a member of an archive.
+struct ElfImage
 {
-    std::uint32_t nameOffset;
+    const unsigned char* data;
     std::uint32_t size;
+    std::string path;
 };
 
-static void Seek(long offset)
+static std::uint32_t ReadInt16(const unsigned char* p)
 {
-    if (std::fseek(s_file, s_elfFileOffset + offset, SEEK_SET) != 0)
-        FATAL_ERROR("error: failed to seek to %ld in \"%s\"", offset, s_elfPath.c_str());
+    return p[0] | (p[1] << 8);
 }
 
-static void Skip(long offset)
+static std::uint32_t ReadInt32(const unsigned char* p)
 {
-    if (std::fseek(s_file, offset, SEEK_CUR) != 0)
-        FATAL_ERROR("error: failed to skip %ld bytes in \"%s\"", offset, s_elfPath.c_str());
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((std::uint32_t)p[3] << 24);
 }
 
-static std::uint32_t ReadInt8()
+static void CheckRange(const ElfImage& elf, std::uint32_t offset, std::uint32_t length)
 {
-    int c = std::fgetc(s_file);
-
-    if (c < 0)
-        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", s_elfPath.c_str());
-
-    return c;
+    if (offset > elf.size || length > elf.size - offset)
+        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", elf.path.c_str());
 }
 
-static std::uint32_t ReadInt16()
+// Returns a name from a string table, making sure it ends inside the table.
+static const char* GetString(const ElfImage& elf, std::uint32_t tableOffset, std::uint32_t tableSize, std::uint32_t nameOffset)
 {
-    std::uint32_t val = 0;
-    val |= ReadInt8();
-    val |= ReadInt8() << 8;
-    return val;
-}
-
-static std::uint32_t ReadInt32()
-{
-    std::uint32_t val = 0;
-    val |= ReadInt8();
-    val |= ReadInt8() << 8;
-    val |= ReadInt8() << 16;
-    val |= ReadInt8() << 24;
-    return val;
-}
+    if (nameOffset >= tableSize)
+        FATAL_ERROR("error: name offset 0x%X is out of range in \"%s\"\n", nameOffset, elf.path.c_str());
 
-static std::string ReadString()
-{
-    std::string s;
-    char c;
+    const char* name = reinterpret_cast<const char*>(elf.data + tableOffset + nameOffset);
 
-    while ((c = ReadInt8()) != 0)
-        s += c;
+    if (std::memchr(name, 0, tableSize - nameOffset) == nullptr)
+        FATAL_ERROR("error: unterminated name in \"%s\"\n", elf.path.c_str());
 
-    return s;
+    return name;
 }
 
-static void VerifyElfIdent()
+static void VerifyElfIdent(const ElfImage& elf)
 {
     char expectedMagic[4] = { 0x7F, 'E', 'L', 'F' };
-    char magic[4];
 
-    if (std::fread(magic, 4, 1, s_file) != 1)
-        FATAL_ERROR("error: failed to read ELF magic from \"%s\"\n", s_elfPath.c_str());
+    if (elf.size < 0x34)
+        FATAL_ERROR("error: failed to read ELF header from \"%s\"\n", elf.path.c_str());
 
-    if (std::memcmp(magic, expectedMagic, 4) != 0)
-        FATAL_ERROR("error: ELF magic did not match in \"%s\"\n", s_elfPath.c_str());
+    if (std::memcmp(elf.data, expectedMagic, 4) != 0)
+        FATAL_ERROR("error: ELF magic did not match in \"%s\"\n", elf.path.c_str());
 
-    if (std::fgetc(s_file) != 1)
-        FATAL_ERROR("error: \"%s\" not 32-bit ELF\n", s_elfPath.c_str());
+    if (elf.data[4] != 1)
+        FATAL_ERROR("error: \"%s\" not 32-bit ELF\n", elf.path.c_str());
 
-    if (std::fgetc(s_file) != 1)
-        FATAL_ERROR("error: \"%s\" not little-endian ELF\n", s_elfPath.c_str());
+    if (elf.data[5] != 1)
+        FATAL_ERROR("error: \"%s\" not little-endian ELF\n", elf.path.c_str());
 }
 
-static void VerifyAr()
+// What ramscrgen needs to know about an object.
+struct ObjectInfo
 {
-    char expectedMagic[8] = {'!', '<', 'a', 'r', 'c', 'h', '>', '\n'};
-    char magic[8];
-
-    if (std::fread(magic, 8, 1, s_file) != 1)
-        FATAL_ERROR("error: failed to read AR magic from \"%s\"\n", s_archiveFilePath.c_str());
-
-    if (std::memcmp(magic, expectedMagic, 8) != 0)
-        FATAL_ERROR("error: AR magic did not match in \"%s\"\n", s_archiveFilePath.c_str());
-}
+    CommonSymbolMap commonSymbols;
+    std::unordered_map<std::string, SectionInfo> sections;
+};
 
-static void ReadElfHeader()
+// Decodes the section header table and symbol table straight from memory.
+static ObjectInfo ReadObject(const ElfImage& elf)
 {
-    Seek(0x20);
-    s_sectionHeaderOffset = ReadInt32();
-    Seek(0x2E);
-    s_sectionHeaderEntrySize = ReadInt16();
-    s_sectionCount = ReadInt16();
-    s_shstrtabIndex = ReadInt16();
-}
+    ProfileScope scope("ReadObject", elf.path.c_str());
+    VerifyElfIdent(elf);
 
-static void FindArObj()
-{
-    char file_ident[17] = {0};
-    char filesize_s[11] = {0};
-    char expectedEndMagic[2] = { 0x60, 0x0a };
-    char end_magic[2];
-    std::size_t filesize;
-
-    Seek(8);
-    while (!std::feof(s_file)) {
-        if (std::fread(file_ident, 16, 1, s_file) != 1)
-            FATAL_ERROR("error: failed to read file ident in \"%s\"\n", s_archiveFilePath.c_str());
-        Skip(32);
-        if (std::fread(filesize_s, 10, 1, s_file) != 1)
-            FATAL_ERROR("error: failed to read filesize in \"%s\"\n", s_archiveFilePath.c_str());
-        if (std::fread(end_magic, 2, 1, s_file) != 1)
-            FATAL_ERROR("error: failed to read end sentinel in \"%s\"\n", s_archiveFilePath.c_str());
-        if (std::memcmp(end_magic, expectedEndMagic, 2) != 0)
-            FATAL_ERROR("error: corrupted archive header in \"%s\" at \"%s\"\n", s_archiveFilePath.c_str(), file_ident);
-
-        char * ptr = std::strchr(file_ident, '/');
-        if (ptr != nullptr)
-            *ptr = 0;
-        filesize = std::strtoul(filesize_s, nullptr, 10);
-        if (std::strncmp(s_archiveObjectPath.c_str(), file_ident, 16) == 0) {
-            s_elfFileOffset = std::ftell(s_file);
-            return;
-        }
-        Skip(filesize);
-    }
+    std::uint32_t sectionHeaderOffset = ReadInt32(elf.data + 0x20);
+    std::uint32_t sectionHeaderEntrySize = ReadInt16(elf.data + 0x2E);
+    std::uint32_t sectionCount = ReadInt16(elf.data + 0x30);
+    std::uint32_t shstrtabIndex = ReadInt16(elf.data + 0x32);
 
-    FATAL_ERROR("error: could not find object \"%s\" in archive \"%s\"\n", s_archiveObjectPath.c_str(), s_archiveFilePath.c_str());
-}
+    if (sectionHeaderEntrySize < 0x28 || shstrtabIndex >= sectionCount)
+        FATAL_ERROR("error: bad section header table in \"%s\"\n", elf.path.c_str());
 
-static std::string GetSectionName(std::uint32_t shstrtabOffset, int index)
-{
-    Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * index);
-    std::uint32_t nameOffset = ReadInt32();
-    Seek(shstrtabOffset + nameOffset);
-    return ReadString();
-}
+    CheckRange(elf, sectionHeaderOffset, sectionHeaderEntrySize * sectionCount);
 
-static void FindTableOffsets()
-{
-    s_symtabOffset = 0;
-    s_strtabOffset = 0;
+    const unsigned char* sectionHeaders = elf.data + sectionHeaderOffset;
+    const unsigned char* shstrtab = sectionHeaders + sectionHeaderEntrySize * shstrtabIndex;
+    std::uint32_t shstrtabOffset = ReadInt32(shstrtab + 0x10);
+    std::uint32_t shstrtabSize = ReadInt32(shstrtab + 0x14);
+
+    CheckRange(elf, shstrtabOffset, shstrtabSize);
 
-    Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * s_shstrtabIndex + 0x10);
-    std::uint32_t shstrtabOffset = ReadInt32();
+    std::uint32_t symtabOffset = 0;
+    std::uint32_t symbolCount = 0;
+    std::uint32_t strtabOffset = 0;
+    std::uint32_t strtabSize = 0;
+    ObjectInfo object;
 
-    for (int i = 0; i < s_sectionCount; i++)
+    for (std::uint32_t i = 0; i < sectionCount; i++)
     {
-        std::string name = GetSectionName(shstrtabOffset, i);
+        const unsigned char* header = sectionHeaders + sectionHeaderEntrySize * i;
+        const char* name = GetString(elf, shstrtabOffset, shstrtabSize, ReadInt32(header));
+        std::uint32_t alignment = ReadInt32(header + 0x20);
+        SectionInfo& section = object.sections[name];
 
-        if (name == ".symtab")
+        section.size += ReadInt32(header + 0x14);
+        if (alignment > section.alignment)
+            section.alignment = alignment;
+
+        if (std::strcmp(name, ".symtab") == 0)
         {
-            if (s_symtabOffset)
-                FATAL_ERROR("error: mutiple .symtab sections found in \"%s\"\n", s_elfPath.c_str());
-            Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * i + 0x10);
-            s_symtabOffset = ReadInt32();
-            std::uint32_t size = ReadInt32();
-            s_symbolCount = size / 16;
+            if (symtabOffset)
+                FATAL_ERROR("error: mutiple .symtab sections found in \"%s\"\n", elf.path.c_str());
+            symtabOffset = ReadInt32(header + 0x10);
+            symbolCount = ReadInt32(header + 0x14) / 16;
         }
-        else if (name == ".strtab")
+        else if (std::strcmp(name, ".strtab") == 0)
         {
-            if (s_strtabOffset)
-                FATAL_ERROR("error: mutiple .strtab sections found in \"%s\"\n", s_elfPath.c_str());
-            Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * i + 0x10);
-            s_strtabOffset = ReadInt32();
+            if (strtabOffset)
+                FATAL_ERROR("error: mutiple .strtab sections found in \"%s\"\n", elf.path.c_str());
+            strtabOffset = ReadInt32(header + 0x10);
+            strtabSize = ReadInt32(header + 0x14);
         }
     }
 
-    if (!s_symtabOffset)
-        FATAL_ERROR("error: couldn't find .symtab section in \"%s\"\n", s_elfPath.c_str());
-
-    if (!s_strtabOffset)
-        FATAL_ERROR("error: couldn't find .strtab section in \"%s\"\n", s_elfPath.c_str());
-}
-
-static std::map<std::string, std::uint32_t> GetCommonSymbols_Shared()
-{
-    VerifyElfIdent();
-    ReadElfHeader();
-    FindTableOffsets();
+    if (!symtabOffset)
+        FATAL_ERROR("error: couldn't find .symtab section in \"%s\"\n", elf.path.c_str());
 
-    std::map<std::string, std::uint32_t> commonSymbols;
+    if (!strtabOffset)
+        FATAL_ERROR("error: couldn't find .strtab section in \"%s\"\n", elf.path.c_str());
 
-    std::vector<Symbol> commonSymbolVec;
+    CheckRange(elf, symtabOffset, symbolCount * 16);
+    CheckRange(elf, strtabOffset, strtabSize);
 
-    Seek(s_symtabOffset);
+    const unsigned char* symbol = elf.data + symtabOffset;
 
-    for (std::uint32_t i = 0; i < s_symbolCount; i++)
+    for (std::uint32_t i = 0; i < symbolCount; i++, symbol += 16)
     {
-        Symbol sym;
-        sym.nameOffset = ReadInt32();
-        Skip(4);
-        sym.size = ReadInt32();
-        Skip(2);
-        std::uint16_t sectionIndex = ReadInt16();
-        if (sectionIndex == SHN_COMMON)
-            commonSymbolVec.push_back(sym);
+        if (ReadInt16(symbol + 14) == SHN_COMMON)
+            object.commonSymbols[GetString(elf, strtabOffset, strtabSize, ReadInt32(symbol))] = ReadInt32(symbol + 8);
     }
 
-    for (const Symbol& sym : commonSymbolVec)
-    {
-        Seek(s_strtabOffset + sym.nameOffset);
-        std::string name = ReadString();
-        commonSymbols[name] = sym.size;
-    }
+    return object;
+}
+
+// Archives and parsed objects are kept for the whole run, since sym files
+// often include several objects from the same library, and the same
+// object can be included more than once.
+static std::unordered_map<std::string, std::unique_ptr<Archive>> s_archives;
+static std::unordered_map<std::string, ObjectInfo> s_objects;
+
+static const Archive& GetArchive(const std::string& path)
+{
+    std::unique_ptr<Archive>& archive = s_archives[path];
+
+    if (!archive)
+        archive.reset(new Archive(path));
 
-    return commonSymbols;
+    return *archive;
 }
 
-std::map<std::string, std::uint32_t> GetCommonSymbolsFromLib(std::string sourcePath, std::string libpath)
+static const ObjectInfo& GetObjectFromLib(std::string sourcePath, std::string libpath)
 {
     std::size_t colonPos = libpath.find(':');
     if (colonPos == std::string::npos)
-        FATAL_ERROR("error: missing colon separator in libfile \"%s\"\n", s_elfPath.c_str());
+        FATAL_ERROR("error: missing colon separator in libfile \"%s\"\n", libpath.c_str());
 
-    s_archiveObjectPath = libpath.substr(colonPos + 1);
-    s_archiveFilePath = sourcePath + "/" + libpath.substr(1, colonPos - 1);
-    s_elfPath = sourcePath + "/" + libpath.substr(1);
+    std::string archiveObjectPath = libpath.substr(colonPos + 1);
+    std::string archiveFilePath = sourcePath + "/" + libpath.substr(1, colonPos - 1);
+    std::string elfPath = archiveFilePath + ":" + archiveObjectPath;
 
-    s_file = std::fopen(s_archiveFilePath.c_str(), "rb");
+    auto it = s_objects.find(elfPath);
 
-    if (s_file == NULL)
-        FATAL_ERROR("error: failed to open \"%s\" for reading\n", s_archiveFilePath.c_str());
+    if (it != s_objects.end())
+        return it->second;
 
-    VerifyAr();
-    FindArObj();
-    return GetCommonSymbols_Shared();
+    const Archive& archive = GetArchive(archiveFilePath);
+    ArchiveMember member;
+
+    if (!archive.FindMember(archiveObjectPath, member))
+        FATAL_ERROR("error: could not find object \"%s\" in archive \"%s\"\n", archiveObjectPath.c_str(), archiveFilePath.c_str());
+
+    return s_objects[elfPath] = ReadObject({ member.data, member.size, elfPath });
 }
 
-std::map<std::string, std::uint32_t> GetCommonSymbols(std::string sourcePath, std::string path)
+static const ObjectInfo& GetObject(std::string sourcePath, std::string path)
 {
-    s_elfFileOffset = 0;
     if (path[0] == '*')
-        return GetCommonSymbolsFromLib(sourcePath, path);
+        return GetObjectFromLib(sourcePath, path);
+
+    std::string elfPath = sourcePath + "/" + path;
+    auto it = s_objects.find(elfPath);
 
-    s_elfPath = sourcePath + "/" + path;
-    s_file = std::fopen(s_elfPath.c_str(), "rb");
+    if (it != s_objects.end())
+        return it->second;
 
-    if (s_file == NULL)
+    MappedFile file(elfPath);
+
+    if (!file.IsOpen())
         FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
 
-    return GetCommonSymbols_Shared();
+    return s_objects[elfPath] = ReadObject({ file.Data(), static_cast<std::uint32_t>(file.Size()), elfPath });
+}
+
+const CommonSymbolMap& GetCommonSymbols(std::string sourcePath, std::string path)
+{
+    return GetObject(sourcePath, path).commonSymbols;
+}
+
+// Returns the size and alignment of a section, or a size of 0 if the object doesn't have it.
+SectionInfo GetSectionInfo(std::string sourcePath, std::string path, std::string sectionName)
+{
+    const ObjectInfo& object = GetObject(sourcePath, path);
+    auto section = object.sections.find(sectionName);
+
+    if (section == object.sections.end())
+        return { 0, 1 };
+
+    return section->second;
 }
@@ -22,9 +22,20 @@
 #define ELF_H
 
 #include <cstdint>
-#include <map>
 #include <string>
+#include <unordered_map>
 
-std::map<std::string, std::uint32_t> GetCommonSymbols(std::string sourcePath, std::string path);
+// Maps the name of each COMMON symbol in an object to its size.
+typedef std::unordered_map<std::string, std::uint32_t> CommonSymbolMap;
+
+// The size and alignment of a section of an object.
+struct SectionInfo
+{
+    std::uint32_t size;
+    std::uint32_t alignment;
+};
+
+const CommonSymbolMap& GetCommonSymbols(std::string sourcePath, std::string path);
+SectionInfo GetSectionInfo(std::string sourcePath, std::string path, std::string sectionName);
 
 #endif // ELF_H
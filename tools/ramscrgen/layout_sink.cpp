@@ -0,0 +1,65 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "layout_sink.h"
+
+void ScriptWriter::Align(unsigned long alignment)
+{
+    std::fprintf(m_out, ". = ALIGN(%lu);\n", alignment);
+}
+
+void ScriptWriter::Advance(unsigned long length)
+{
+    std::fprintf(m_out, ". += 0x%lX;\n", length);
+}
+
+void ScriptWriter::Label(const std::string& name)
+{
+    std::fprintf(m_out, "%s = .;\n", name.c_str());
+}
+
+void ScriptWriter::InputSection(const std::string& path, const std::string& sourcePath, const std::string& sectionName)
+{
+    std::fprintf(m_out, "%s(%s);\n", path.c_str(), sectionName.c_str());
+}
+
+void LayoutTee::Align(unsigned long alignment)
+{
+    m_first.Align(alignment);
+    m_second.Align(alignment);
+}
+
+void LayoutTee::Advance(unsigned long length)
+{
+    m_first.Advance(length);
+    m_second.Advance(length);
+}
+
+void LayoutTee::Label(const std::string& name)
+{
+    m_first.Label(name);
+    m_second.Label(name);
+}
+
+void LayoutTee::InputSection(const std::string& path, const std::string& sourcePath, const std::string& sectionName)
+{
+    m_first.InputSection(path, sourcePath, sectionName);
+    m_second.InputSection(path, sourcePath, sectionName);
+}
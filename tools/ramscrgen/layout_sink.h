@@ -0,0 +1,71 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef LAYOUT_SINK_H
+#define LAYOUT_SINK_H
+
+#include <cstdio>
+#include <string>
+
+// Receives the linker script commands that a sym file turns into.
+class LayoutSink
+{
+public:
+    virtual ~LayoutSink() {}
+    // Sets address to where the next command takes effect, if that's known.
+    virtual bool GetAddress(unsigned long& address) const { return false; }
+    virtual void Align(unsigned long alignment) = 0;
+    virtual void Advance(unsigned long length) = 0;
+    virtual void Label(const std::string& name) = 0;
+    virtual void InputSection(const std::string& path, const std::string& sourcePath, const std::string& sectionName) = 0;
+};
+
+// Writes the commands out as a linker script fragment.
+class ScriptWriter : public LayoutSink
+{
+public:
+    ScriptWriter(FILE* out) : m_out(out) {}
+    void Align(unsigned long alignment);
+    void Advance(unsigned long length);
+    void Label(const std::string& name);
+    void InputSection(const std::string& path, const std::string& sourcePath, const std::string& sectionName);
+
+private:
+    FILE* m_out;
+};
+
+// Passes the commands on to two sinks, so that a fragment can be written and
+// reported on in one pass.
+class LayoutTee : public LayoutSink
+{
+public:
+    LayoutTee(LayoutSink& first, LayoutSink& second) : m_first(first), m_second(second) {}
+    bool GetAddress(unsigned long& address) const { return m_first.GetAddress(address) || m_second.GetAddress(address); }
+    void Align(unsigned long alignment);
+    void Advance(unsigned long length);
+    void Label(const std::string& name);
+    void InputSection(const std::string& path, const std::string& sourcePath, const std::string& sectionName);
+
+private:
+    LayoutSink& m_first;
+    LayoutSink& m_second;
+};
+
+#endif // LAYOUT_SINK_H
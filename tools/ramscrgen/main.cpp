@@ -21,13 +21,20 @@
 #include <cstdio>
 #include <cstring>
 #include <string>
+#include <vector>
 #include "ramscrgen.h"
 #include "sym_file.h"
 #include "elf.h"
+#include "common_layout.h"
+#include "layout_sink.h"
+#include "ram_report.h"
+#include "profile.h"
 
-void HandleCommonInclude(std::string filename, std::string sourcePath, std::string symOrderPath, std::string lang)
+// Returns how many bytes packing saved, which is 0 unless pack is set. If the
+// sink doesn't know the address, this is the least it saves at any 4-byte aligned start.
+unsigned long HandleCommonInclude(std::string filename, std::string sourcePath, std::string symOrderPath, std::string lang, bool pack, LayoutSink& sink)
 {
-    auto commonSymbols = GetCommonSymbols(sourcePath, filename);
+    const auto& commonSymbols = GetCommonSymbols(sourcePath, filename);
     std::size_t dotIndex;
 
     if (filename[0] == '*') {
@@ -42,113 +49,329 @@ void HandleCommonInclude(std::string filename, std::string sourcePath, std::stri
 
     std::string symOrderFilename = filename.substr(0, dotIndex + 1) + "txt";
 
-    SymFile symFile(symOrderPath + "/" + symOrderFilename);
+    SymFile& symFile = GetSymFile(symOrderPath + "/" + symOrderFilename, SymFileType::CommonOrder);
+    std::vector<CommonEntry> entries;
 
-    while (!symFile.IsAtEnd())
+    for (const Statement* statement : symFile.GetStatements(lang))
     {
-        symFile.HandleLangConditional(lang);
+        if (statement->type == StatementType::Gap)
+        {
+            entries.push_back({ "", statement->value, 1 });
+        }
+        else
+        {
+            auto symbol = commonSymbols.find(statement->name);
+            if (symbol == commonSymbols.end())
+                symFile.RaiseError(*statement, "no common symbol named \"%s\"", statement->name.c_str());
+            entries.push_back({ statement->name, symbol->second, GetCommonAlignment(symbol->second) });
+        }
+    }
 
-        std::string label = symFile.GetLabel(false);
+    unsigned long saved = 0;
+
+    if (pack)
+    {
+        unsigned long address = 0;
+        bool exactAddress = sink.GetAddress(address);
 
-        if (label.length() == 0)
+        saved = PackCommonEntries(entries, address, exactAddress);
+    }
+
+    for (const CommonEntry& entry : entries)
+    {
+        if (entry.label.empty())
         {
-            unsigned long length;
-            if (symFile.ReadInteger(length))
-            {
-                if (length & 3)
-                    symFile.RaiseWarning("gap length %d is not multiple of 4", length);
-                printf(". += 0x%lX;\n", length);
-            }
+            sink.Advance(entry.size);
         }
         else
         {
-            if (commonSymbols.count(label) == 0)
-                symFile.RaiseError("no common symbol named \"%s\"", label.c_str());
-            unsigned long size = commonSymbols[label];
-            int alignment = 4;
-            if (size > 4)
-                alignment = 8;
-            if (size > 8)
-                alignment = 16;
-            printf(". = ALIGN(%d);\n", alignment);
-            printf("%s = .;\n", label.c_str());
-            printf(". += 0x%lX;\n", size);
+            sink.Align(entry.alignment);
+            sink.Label(entry.label);
+            sink.Advance(entry.size);
         }
-
-        symFile.ExpectEmptyRestOfLine();
     }
+
+    return saved;
 }
 
-void ConvertSymFile(std::string filename, std::string sectionName, std::string lang, bool common, std::string sourcePath, std::string commonSymPath, std::string libSourcePath)
+void ConvertSymFile(std::string filename, std::string sectionName, std::string lang, bool common, bool pack, std::string sourcePath, std::string commonSymPath, std::string libSourcePath, LayoutSink& sink)
 {
-    SymFile symFile(filename);
+    ProfileScope scope("ConvertSymFile", filename.c_str());
+    SymFile& symFile = GetSymFile(filename, SymFileType::Sym);
+    unsigned long saved = 0;
 
-    while (!symFile.IsAtEnd())
+    for (const Statement* statement : symFile.GetStatements(lang))
     {
-        symFile.HandleLangConditional(lang);
-
-        Directive directive = symFile.GetDirective();
-
-        switch (directive)
+        switch (statement->type)
         {
-        case Directive::Include:
+        case StatementType::Include:
         {
-            std::string incFilename = symFile.ReadPath();
-            symFile.ExpectEmptyRestOfLine();
-            printf(". = ALIGN(4);\n");
+            const std::string& objectSourcePath = statement->name[0] == '*' ? libSourcePath : sourcePath;
+
+            sink.Align(4);
             if (common)
-                HandleCommonInclude(incFilename, incFilename[0] == '*' ? libSourcePath : sourcePath, commonSymPath, lang);
+                saved += HandleCommonInclude(statement->name, objectSourcePath, commonSymPath, lang, pack, sink);
             else
-                printf("%s(%s);\n", incFilename.c_str(), sectionName.c_str());
+                sink.InputSection(statement->name, objectSourcePath, sectionName);
             break;
         }
-        case Directive::Space:
-        {
-            unsigned long length;
-            if (!symFile.ReadInteger(length))
-                symFile.RaiseError("expected integer after .space directive");
-            symFile.ExpectEmptyRestOfLine();
-            printf(". += 0x%lX;\n", length);
+        case StatementType::Space:
+            sink.Advance(statement->value);
             break;
-        }
-        case Directive::Align:
-        {
-            unsigned long amount;
-            if (!symFile.ReadInteger(amount))
-                symFile.RaiseError("expected integer after .align directive");
-            if (amount > 4)
-                symFile.RaiseError("max alignment amount is 4");
-            amount = 1UL << amount;
-            symFile.ExpectEmptyRestOfLine();
-            printf(". = ALIGN(%lu);\n", amount);
+        case StatementType::Align:
+            sink.Align(statement->value);
+            break;
+        case StatementType::Label:
+            sink.Label(statement->name);
             break;
         }
-        case Directive::Unknown:
-        {
-            std::string label = symFile.GetLabel();
+    }
+
+    unsigned long address;
+
+    if (pack && sink.GetAddress(address))
+        fprintf(stderr, "%s: packing COMMON symbols saved %lu bytes\n", filename.c_str(), saved);
+    else if (pack)
+        fprintf(stderr, "%s: packing COMMON symbols saved at least %lu bytes, depending on where the section starts\n", filename.c_str(), saved);
+}
+
+// Splits "SRC_PATH,COMMON_SYM_PATH[,LIB_PATH]".
+void ParseCommonPaths(std::string paths, std::string& sourcePath, std::string& commonSymPath, std::string& libSourcePath)
+{
+    std::size_t commaPos = paths.find(',');
 
-            if (label.length() != 0)
+    if (commaPos == std::string::npos)
+        FATAL_ERROR("error: missing comma in argument after \"-c\"\n");
+
+    sourcePath = paths.substr(0, commaPos);
+    commonSymPath = paths.substr(commaPos + 1);
+    commaPos = commonSymPath.find(',');
+    if (commaPos == std::string::npos) {
+        libSourcePath = "tools/agbcc/lib";
+    } else {
+        libSourcePath = commonSymPath.substr(commaPos + 1);
+        commonSymPath = commonSymPath.substr(0, commaPos);
+    }
+}
+
+// Converts every sym file listed in a manifest, sharing the parsed objects and
+// archives between them. Each line is "OUTPUT SECTION_NAME SYM_FILE LANG [COMMON_PATHS]",
+// where COMMON_PATHS is what would follow "-c" and an OUTPUT of "-" means stdout.
+// Blank lines and lines starting with '#' are ignored.
+// If report is set, the sections are also laid out in it, finding objects
+// outside of COMMON_PATHS in objectPath. Nothing is written unless writeOutputs is set.
+void ConvertManifest(std::string manifestName, bool pack, bool writeOutputs, RamReport* report, std::string objectPath)
+{
+    FILE *fp = manifestName == "-" ? stdin : std::fopen(manifestName.c_str(), "r");
+
+    if (fp == NULL)
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", manifestName.c_str());
+
+    char line[1024];
+    int lineNum = 0;
+
+    while (std::fgets(line, sizeof(line), fp) != NULL)
+    {
+        lineNum++;
+
+        char output[kMaxPath + 1];
+        char sectionName[kMaxPath + 1];
+        char symFileName[kMaxPath + 1];
+        char lang[kMaxPath + 1];
+        char paths[3 * kMaxPath + 1];
+        char first[2];
+
+        if (std::sscanf(line, " %1s", first) != 1 || first[0] == '#')
+            continue;
+
+        int count = std::sscanf(line, "%256s %256s %256s %256s %768s", output, sectionName, symFileName, lang, paths);
+
+        if (count < 4)
+            FATAL_ERROR("error: %s:%d: expected OUTPUT SECTION_NAME SYM_FILE LANG [COMMON_PATHS]\n", manifestName.c_str(), lineNum);
+
+        bool common = (count == 5);
+        std::string sourcePath;
+        std::string commonSymPath;
+        std::string libSourcePath;
+
+        if (common)
+            ParseCommonPaths(paths, sourcePath, commonSymPath, libSourcePath);
+
+        if (report)
+        {
+            if (!common)
             {
-                printf("%s = .;\n", label.c_str());
+                sourcePath = objectPath;
+                libSourcePath = "tools/agbcc/lib";
             }
 
-            symFile.ExpectEmptyRestOfLine();
+            report->BeginSection(sectionName);
+        }
 
-            break;
+        if (!writeOutputs)
+        {
+            ConvertSymFile(symFileName, sectionName, lang, common, pack && common, sourcePath, commonSymPath, libSourcePath, *report);
+            continue;
+        }
+
+        bool toStdout = (std::strcmp(output, "-") == 0);
+        FILE *out = toStdout ? stdout : std::fopen(output, "wb");
+
+        if (out == NULL)
+            FATAL_ERROR("error: failed to open \"%s\" for writing\n", output);
+
+        ScriptWriter writer(out);
+
+        if (report)
+        {
+            LayoutTee tee(writer, *report);
+            ConvertSymFile(symFileName, sectionName, lang, common, pack && common, sourcePath, commonSymPath, libSourcePath, tee);
         }
+        else
+        {
+            ConvertSymFile(symFileName, sectionName, lang, common, pack && common, sourcePath, commonSymPath, libSourcePath, writer);
+        }
+
+        if (!toStdout)
+        {
+            PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+            PROFILE_COUNT(PROFILE_BYTES_WRITTEN, std::ftell(out));
+        }
+
+        if (!toStdout && std::fclose(out) != 0)
+            FATAL_ERROR("error: failed to write \"%s\"\n", output);
+    }
+
+    if (fp != stdin)
+        std::fclose(fp);
+}
+
+// Splits "SECTION_NAME=VALUE", where VALUE may be decimal or hex.
+void ParseSectionValue(const char* option, const char* arg, std::string& sectionName, unsigned long& value)
+{
+    const char* equals = std::strchr(arg, '=');
+    char* end;
+
+    if (equals == nullptr || equals == arg)
+        FATAL_ERROR("error: expected SECTION_NAME=VALUE after \"%s\"\n", option);
+
+    sectionName = std::string(arg, equals - arg);
+    value = std::strtoul(equals + 1, &end, 0);
+
+    if (equals[1] == 0 || *end != 0)
+        FATAL_ERROR("error: bad value \"%s\" after \"%s\"\n", equals + 1, option);
+}
+
+// Handles "--manifest" and "--report". The manifest's outputs are written unless
+// writeOutputs is clear, and a report is printed to stdout when writeOutputs is
+// clear or to the file given by "--report-file". Returns 1 if a section is over its budget.
+int RunManifest(int argc, char **argv, bool writeOutputs)
+{
+    RamReport report;
+    std::string objectPath = ".";
+    std::string reportFileName;
+    unsigned long top = 10;
+    bool listAll = false;
+    bool pack = false;
+
+    for (int i = 3; i < argc; i++)
+    {
+        std::string sectionName;
+        unsigned long value;
+
+        if (std::strcmp(argv[i], "--pack-common") == 0)
+        {
+            pack = true;
+        }
+        else if (std::strcmp(argv[i], "--all") == 0)
+        {
+            listAll = true;
+        }
+        else if (i + 1 >= argc)
+        {
+            FATAL_ERROR("error: unrecognized argument \"%s\"\n", argv[i]);
+        }
+        else if (std::strcmp(argv[i], "--report-file") == 0)
+        {
+            reportFileName = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--objects") == 0)
+        {
+            objectPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--top") == 0)
+        {
+            top = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--base") == 0)
+        {
+            ParseSectionValue(argv[i], argv[i + 1], sectionName, value);
+            report.SetBase(sectionName, value);
+            i++;
+        }
+        else if (std::strcmp(argv[i], "--budget") == 0)
+        {
+            ParseSectionValue(argv[i], argv[i + 1], sectionName, value);
+            report.SetBudget(sectionName, value);
+            i++;
+        }
+        else
+        {
+            FATAL_ERROR("error: unrecognized argument \"%s\"\n", argv[i]);
         }
     }
+
+    bool reporting = !writeOutputs || !reportFileName.empty();
+
+    ConvertManifest(argv[2], pack, writeOutputs, reporting ? &report : nullptr, objectPath);
+
+    if (!reporting)
+        return 0;
+
+    if (reportFileName.empty())
+        return report.Print(stdout, top, listAll) ? 0 : 1;
+
+    FILE *fp = std::fopen(reportFileName.c_str(), "w");
+
+    if (fp == NULL)
+        FATAL_ERROR("error: failed to open \"%s\" for writing\n", reportFileName.c_str());
+
+    bool withinBudget = report.Print(fp, top, listAll);
+
+    if (std::fclose(fp) != 0)
+        FATAL_ERROR("error: failed to write \"%s\"\n", reportFileName.c_str());
+
+    return withinBudget ? 0 : 1;
 }
 
 int main(int argc, char **argv)
 {
+    ProfileInit("ramscrgen", &argc, argv);
+
+    if (argc >= 3 && std::strcmp(argv[1], "--manifest") == 0)
+        return RunManifest(argc, argv, true);
+
+    if (argc >= 3 && std::strcmp(argv[1], "--report") == 0)
+        return RunManifest(argc, argv, false);
+
     if (argc < 4)
     {
-        fprintf(stderr, "Usage: %s SECTION_NAME SYM_FILE LANG [-c SRC_PATH,COMMON_SYM_PATH]", argv[0]);
+        fprintf(stderr, "Usage: %s SECTION_NAME SYM_FILE LANG [-c SRC_PATH,COMMON_SYM_PATH] [--pack-common]\n"
+                        "       %s --manifest MANIFEST_FILE [--report-file FILE] [REPORT_OPTIONS] [--pack-common]\n"
+                        "       %s --report MANIFEST_FILE [REPORT_OPTIONS] [--pack-common]\n"
+                        "REPORT_OPTIONS are [--objects DIR] [--base SECTION_NAME=ADDRESS]... [--budget SECTION_NAME=SIZE]...\n"
+                        "                   [--top N] [--all]\n"
+                        "Each line of MANIFEST_FILE is \"OUTPUT SECTION_NAME SYM_FILE LANG [SRC_PATH,COMMON_SYM_PATH]\".\n"
+                        "--pack-common reorders COMMON symbols to reduce alignment padding.\n"
+                        "--report prints where each section's symbols end up instead of writing the outputs,\n"
+                        "reading objects outside of COMMON_PATHS from DIR. It fails if a section is over budget.\n"
+                        "--report-file writes the outputs and puts the same report in FILE.\n",
+                argv[0], argv[0], argv[0]);
         return 1;
     }
 
     bool common = false;
+    bool pack = false;
     std::string sectionName = std::string(argv[1]);
     std::string symFileName = std::string(argv[2]);
     std::string lang = std::string(argv[3]);
@@ -156,32 +379,26 @@ int main(int argc, char **argv)
     std::string commonSymPath;
     std::string libSourcePath;
 
-    if (argc > 4)
+    for (int i = 4; i < argc; i++)
     {
-        if (std::strcmp(argv[4], "-c") != 0)
-            FATAL_ERROR("error: unrecognized argument \"%s\"\n", argv[4]);
+        if (std::strcmp(argv[i], "--pack-common") == 0)
+        {
+            pack = true;
+            continue;
+        }
 
-        if (argc < 6)
+        if (std::strcmp(argv[i], "-c") != 0)
+            FATAL_ERROR("error: unrecognized argument \"%s\"\n", argv[i]);
+
+        if (i + 1 >= argc)
             FATAL_ERROR("error: missing SRC_PATH,COMMON_SYM_PATH after \"-c\"\n");
 
         common = true;
-        std::string paths = std::string(argv[5]);
-        std::size_t commaPos = paths.find(',');
-
-        if (commaPos == std::string::npos)
-            FATAL_ERROR("error: missing comma in argument after \"-c\"\n");
-
-        sourcePath = paths.substr(0, commaPos);
-        commonSymPath = paths.substr(commaPos + 1);
-        commaPos = commonSymPath.find(',');
-        if (commaPos == std::string::npos) {
-            libSourcePath = "tools/agbcc/lib";
-        } else {
-            libSourcePath = commonSymPath.substr(commaPos + 1);
-            commonSymPath = commonSymPath.substr(0, commaPos);
-        }
+        ParseCommonPaths(argv[++i], sourcePath, commonSymPath, libSourcePath);
     }
 
-    ConvertSymFile(symFileName, sectionName, lang, common, sourcePath, commonSymPath, libSourcePath);
+    ScriptWriter writer(stdout);
+
+    ConvertSymFile(symFileName, sectionName, lang, common, pack && common, sourcePath, commonSymPath, libSourcePath, writer);
     return 0;
 }
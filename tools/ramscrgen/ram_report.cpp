@@ -0,0 +1,163 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include "ramscrgen.h"
+#include "ram_report.h"
+#include "elf.h"
+
+// Starts a section at its base address, which is 0 unless one was given.
+void RamReport::BeginSection(const std::string& sectionName)
+{
+    auto base = m_bases.find(sectionName);
+
+    m_address = (base != m_bases.end()) ? base->second : 0;
+    m_openItem = -1;
+    m_sections.push_back({ sectionName, m_address, m_address, 0, {} });
+}
+
+RamReport::Section& RamReport::CurrentSection()
+{
+    if (m_sections.empty())
+        FATAL_ERROR("error: RAM report has no section\n");
+
+    return m_sections.back();
+}
+
+void RamReport::AlignTo(unsigned long alignment)
+{
+    Section& section = CurrentSection();
+
+    if (alignment == 0)
+        alignment = 1;
+
+    unsigned long aligned = (m_address + alignment - 1) / alignment * alignment;
+
+    section.padding += aligned - m_address;
+    m_address = aligned;
+    section.end = m_address;
+}
+
+void RamReport::Align(unsigned long alignment)
+{
+    m_openItem = -1;
+    AlignTo(alignment);
+}
+
+// Space after a label counts towards the label's size.
+void RamReport::Advance(unsigned long length)
+{
+    Section& section = CurrentSection();
+
+    if (m_openItem >= 0)
+        section.items[m_openItem].size += length;
+
+    m_address += length;
+    section.end = m_address;
+}
+
+void RamReport::Label(const std::string& name)
+{
+    Section& section = CurrentSection();
+
+    m_openItem = section.items.size();
+    section.items.push_back({ name, m_address, 0 });
+}
+
+void RamReport::InputSection(const std::string& path, const std::string& sourcePath, const std::string& sectionName)
+{
+    SectionInfo info = GetSectionInfo(sourcePath, path, sectionName);
+
+    m_openItem = -1;
+    AlignTo(info.alignment);
+
+    Section& section = CurrentSection();
+
+    section.items.push_back({ path + "(" + sectionName + ")", m_address, info.size });
+    m_address += info.size;
+    section.end = m_address;
+}
+
+// Prints the usage of each section with its largest items, or all of them
+// if listAll is set. Returns false if a section is over its budget.
+bool RamReport::Print(FILE* out, unsigned int top, bool listAll)
+{
+    bool withinBudget = true;
+
+    for (const Section& section : m_sections)
+    {
+        unsigned long used = section.end - section.start;
+
+        std::fprintf(out, "%s: 0x%lX-0x%lX, %lu bytes used, %lu bytes of alignment padding",
+                     section.name.c_str(), section.start, section.end, used, section.padding);
+
+        auto budget = m_budgets.find(section.name);
+
+        if (budget != m_budgets.end())
+            std::fprintf(out, ", %lu of %lu budgeted bytes", used, budget->second);
+
+        std::fputc('\n', out);
+
+        std::vector<const Item*> items;
+
+        for (const Item& item : section.items)
+            items.push_back(&item);
+
+        if (!listAll)
+        {
+            std::stable_sort(items.begin(), items.end(), [](const Item* a, const Item* b) { return a->size > b->size; });
+
+            if (items.size() > top)
+                items.resize(top);
+        }
+
+        for (const Item* item : items)
+            std::fprintf(out, "  0x%08lX %8lu  %s\n", item->address, item->size, item->name.c_str());
+    }
+
+    std::fflush(out);
+
+    for (const Section& section : m_sections)
+    {
+        unsigned long used = section.end - section.start;
+        auto budget = m_budgets.find(section.name);
+
+        if (budget != m_budgets.end() && used > budget->second)
+        {
+            std::fprintf(stderr, "error: section \"%s\" uses %lu bytes, which is %lu over its budget of %lu\n",
+                         section.name.c_str(), used, used - budget->second, budget->second);
+            withinBudget = false;
+        }
+    }
+
+    for (const auto& budget : m_budgets)
+    {
+        bool found = false;
+
+        for (const Section& section : m_sections)
+            if (section.name == budget.first)
+                found = true;
+
+        if (!found)
+            std::fprintf(stderr, "warning: there is no section \"%s\" to check the budget of\n", budget.first.c_str());
+    }
+
+    return withinBudget;
+}
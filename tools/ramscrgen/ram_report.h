@@ -0,0 +1,75 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef RAM_REPORT_H
+#define RAM_REPORT_H
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "layout_sink.h"
+
+// Works out where everything in a section ends up by following the same
+// commands the linker script would, using the section sizes and alignments
+// from the objects.
+class RamReport : public LayoutSink
+{
+public:
+    RamReport() : m_address(0), m_openItem(-1) {}
+    void SetBase(const std::string& sectionName, unsigned long address) { m_bases[sectionName] = address; }
+    void SetBudget(const std::string& sectionName, unsigned long size) { m_budgets[sectionName] = size; }
+    void BeginSection(const std::string& sectionName);
+    bool GetAddress(unsigned long& address) const { address = m_address; return true; }
+    void Align(unsigned long alignment);
+    void Advance(unsigned long length);
+    void Label(const std::string& name);
+    void InputSection(const std::string& path, const std::string& sourcePath, const std::string& sectionName);
+    bool Print(FILE* out, unsigned int top, bool listAll);
+
+private:
+    // A symbol or an object's input section.
+    struct Item
+    {
+        std::string name;
+        unsigned long address;
+        unsigned long size;
+    };
+
+    struct Section
+    {
+        std::string name;
+        unsigned long start;
+        unsigned long end;
+        unsigned long padding;
+        std::vector<Item> items;
+    };
+
+    std::vector<Section> m_sections;
+    std::unordered_map<std::string, unsigned long> m_bases;
+    std::unordered_map<std::string, unsigned long> m_budgets;
+    unsigned long m_address;
+    long m_openItem;
+
+    Section& CurrentSection();
+    void AlignTo(unsigned long alignment);
+};
+
+#endif // RAM_REPORT_H
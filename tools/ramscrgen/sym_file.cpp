@@ -21,11 +21,13 @@
 #include <cstdio>
 #include <cstdarg>
 #include <climits>
+#include <memory>
 #include "ramscrgen.h"
 #include "sym_file.h"
 #include "char_util.h"
+#include "profile.h"
 
-SymFile::SymFile(std::string filename) : m_filename(filename)
+SymFile::SymFile(std::string filename, SymFileType type) : m_filename(filename), m_type(type)
 {
     FILE *fp = std::fopen(filename.c_str(), "rb");
 
@@ -50,23 +52,18 @@ SymFile::SymFile(std::string filename) : m_filename(filename)
 
     std::fclose(fp);
 
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_READ, m_size);
+
     m_pos = 0;
     m_lineNum = 1;
     m_lineStart = 0;
-    m_inLangConditional = false;
 
     RemoveComments();
-}
+    SplitLines();
 
-SymFile::SymFile(SymFile&& other) : m_filename(std::move(other.m_filename))
-{
-    m_buffer = other.m_buffer;
-    m_pos = other.m_pos;
-    m_size = other.m_size;
-    m_lineNum = other.m_lineNum;
-    m_lineStart = other.m_lineStart;
-
-    other.m_buffer = nullptr;
+    m_statements.resize(m_lines.size());
+    m_parsed.resize(m_lines.size(), false);
 }
 
 SymFile::~SymFile()
@@ -389,104 +386,229 @@ void SymFile::ExpectEmptyRestOfLine()
 }
 
 
+// Moves to the next line without looking at the rest of this one.
 void SymFile::SkipLine()
 {
-    while (m_buffer[m_pos] != 0 && m_buffer[m_pos] != '\n')
+    while (m_pos < m_size && m_buffer[m_pos] != '\n')
         m_pos++;
 
-    if (m_buffer[m_pos] == '\n')
+    if (m_pos < m_size)
         m_pos++;
 }
 
-// Checks if we're at the end of the file.
-bool SymFile::IsAtEnd()
+// Finds the start of each line and which language conditional it's in.
+// The # directives are handled here, once for every language.
+void SymFile::SplitLines()
 {
-    return (m_pos >= m_size);
-}
+    int langIndex = -1;
+    long beginLineNum = 0;
 
-void SymFile::HandleLangConditional(std::string lang)
-{
-    if (m_buffer[m_pos] != '#')
-        return;
-
-    m_pos++;
+    m_pos = 0;
+    m_lineNum = 1;
 
-    if (CheckForDirective("begin"))
+    while (m_pos < m_size)
     {
-        if (m_inLangConditional)
-            RaiseError("already inside language conditional");
+        m_lineStart = m_pos;
 
-        SkipWhitespace();
+        if (m_buffer[m_pos] != '#')
+        {
+            m_lines.push_back({ m_pos, m_lineNum, langIndex });
+            SkipLine();
+            m_lineNum++;
+            continue;
+        }
 
-        std::string label = GetLabel(false);
+        m_pos++;
+
+        if (CheckForDirective("begin"))
+        {
+            if (langIndex != -1)
+                RaiseError("already inside language conditional");
 
-        if (label.length() == 0)
-            RaiseError("no language name after #begin");
+            SkipWhitespace();
 
-        ExpectEmptyRestOfLine();
+            std::string lang = GetLabel(false);
 
-        if (lang == label)
+            if (lang.length() == 0)
+                RaiseError("no language name after #begin");
+
+            for (langIndex = 0; langIndex < (int)m_langs.size(); langIndex++)
+                if (m_langs[langIndex] == lang)
+                    break;
+
+            if (langIndex == (int)m_langs.size())
+                m_langs.push_back(lang);
+
+            beginLineNum = m_lineNum;
+            ExpectEmptyRestOfLine();
+        }
+        else if (CheckForDirective("end"))
         {
-            m_inLangConditional = true;
+            if (langIndex == -1)
+                RaiseError("not inside language conditional");
+
+            langIndex = -1;
+            ExpectEmptyRestOfLine();
         }
         else
         {
-            while (!IsAtEnd() && m_buffer[m_pos] != '#')
-                SkipLine();
+            RaiseError("unknown # directive");
+        }
+    }
 
-            if (m_buffer[m_pos] != '#')
-                RaiseError("unterminated language conditional");
+    if (langIndex != -1)
+    {
+        m_lineNum = beginLineNum;
+        RaiseError("unterminated language conditional");
+    }
+}
 
-            m_pos++;
+void SymFile::ParseLine(std::size_t index)
+{
+    const Line& line = m_lines[index];
+    Statement& statement = m_statements[index];
 
-            if (!CheckForDirective("end"))
-                RaiseError("expected #end");
+    m_pos = line.start;
+    m_lineStart = line.start;
+    m_lineNum = line.lineNum;
 
-            ExpectEmptyRestOfLine();
-        }
-    }
-    else if (CheckForDirective("end"))
+    statement.type = StatementType::Empty;
+    statement.value = 0;
+    statement.lineNum = line.lineNum;
+
+    if (m_type == SymFileType::CommonOrder)
     {
-        if (!m_inLangConditional)
-            RaiseError("not inside language conditional");
+        statement.name = GetLabel(false);
 
-        m_inLangConditional = false;
+        if (statement.name.length() != 0)
+        {
+            statement.type = StatementType::Label;
+        }
+        else if (ReadInteger(statement.value))
+        {
+            if (statement.value & 3)
+                RaiseWarning("gap length %lu is not multiple of 4", statement.value);
+            statement.type = StatementType::Gap;
+        }
 
         ExpectEmptyRestOfLine();
+        return;
     }
-    else
+
+    switch (GetDirective())
+    {
+    case Directive::Include:
+        statement.type = StatementType::Include;
+        statement.name = ReadPath();
+        break;
+    case Directive::Space:
+        if (!ReadInteger(statement.value))
+            RaiseError("expected integer after .space directive");
+        statement.type = StatementType::Space;
+        break;
+    case Directive::Align:
+        if (!ReadInteger(statement.value))
+            RaiseError("expected integer after .align directive");
+        if (statement.value > 4)
+            RaiseError("max alignment amount is 4");
+        statement.type = StatementType::Align;
+        statement.value = 1UL << statement.value;
+        break;
+    case Directive::Unknown:
+        statement.name = GetLabel();
+        if (statement.name.length() != 0)
+            statement.type = StatementType::Label;
+        break;
+    }
+
+    ExpectEmptyRestOfLine();
+}
+
+// Returns the non-empty statements that apply to a language. Each line is
+// parsed the first time a language needs it, and the list is kept for the
+// next file that uses the same language.
+const std::vector<const Statement*>& SymFile::GetStatements(const std::string& lang)
+{
+    auto found = m_langStatements.find(lang);
+
+    if (found != m_langStatements.end())
+        return found->second;
+
+    int langIndex;
+
+    for (langIndex = 0; langIndex < (int)m_langs.size(); langIndex++)
+        if (m_langs[langIndex] == lang)
+            break;
+
+    std::vector<const Statement*>& statements = m_langStatements[lang];
+
+    for (std::size_t i = 0; i < m_lines.size(); i++)
     {
-        RaiseError("unknown # directive");
+        if (m_lines[i].langIndex != -1 && m_lines[i].langIndex != langIndex)
+            continue;
+
+        if (!m_parsed[i])
+        {
+            ParseLine(i);
+            m_parsed[i] = true;
+        }
+
+        if (m_statements[i].type != StatementType::Empty)
+            statements.push_back(&m_statements[i]);
     }
+
+    return statements;
 }
 
 // Reports a diagnostic message.
-void SymFile::ReportDiagnostic(const char* type, const char* format, std::va_list args)
+void SymFile::ReportDiagnostic(long lineNum, const char* type, const char* format, std::va_list args)
 {
     const int bufferSize = 1024;
     char buffer[bufferSize];
     std::vsnprintf(buffer, bufferSize, format, args);
-    std::fprintf(stderr, "%s:%ld: %s: %s\n", m_filename.c_str(), m_lineNum, type, buffer);
+    std::fprintf(stderr, "%s:%ld: %s: %s\n", m_filename.c_str(), lineNum, type, buffer);
 }
 
-#define DO_REPORT(type)                   \
-do                                        \
-{                                         \
-    std::va_list args;                    \
-    va_start(args, format);               \
-    ReportDiagnostic(type, format, args); \
-    va_end(args);                         \
+#define DO_REPORT(lineNum, type)                   \
+do                                                 \
+{                                                  \
+    std::va_list args;                             \
+    va_start(args, format);                        \
+    ReportDiagnostic(lineNum, type, format, args); \
+    va_end(args);                                  \
 } while (0)
 
 // Reports an error diagnostic and terminates the program.
 void SymFile::RaiseError(const char* format, ...)
 {
-    DO_REPORT("error");
+    DO_REPORT(m_lineNum, "error");
+    std::exit(1);
+}
+
+// Reports an error diagnostic on a statement's line and terminates the program.
+void SymFile::RaiseError(const Statement& statement, const char* format, ...)
+{
+    DO_REPORT(statement.lineNum, "error");
     std::exit(1);
 }
 
 // Reports a warning diagnostic.
 void SymFile::RaiseWarning(const char* format, ...)
 {
-    DO_REPORT("warning");
+    DO_REPORT(m_lineNum, "warning");
+}
+
+static std::unordered_map<std::string, std::unique_ptr<SymFile>> s_symFiles;
+
+// Returns a sym file, reading and splitting it the first time it's used.
+SymFile& GetSymFile(std::string filename, SymFileType type)
+{
+    std::unique_ptr<SymFile>& symFile = s_symFiles[filename];
+
+    if (!symFile)
+        symFile.reset(new SymFile(filename, type));
+    else if (symFile->GetType() != type)
+        FATAL_ERROR("error: \"%s\" is used as both a sym file and a common symbol order file\n", filename.c_str());
+
+    return *symFile;
 }
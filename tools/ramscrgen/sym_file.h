@@ -24,6 +24,8 @@
 #include <cstdarg>
 #include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include "ramscrgen.h"
 
 enum class Directive
@@ -34,38 +36,82 @@ enum class Directive
     Unknown
 };
 
+// Sym files list what goes in a section. Common symbol order files list the
+// COMMON symbols of one object, and the gaps between them.
+enum class SymFileType
+{
+    Sym,
+    CommonOrder
+};
+
+enum class StatementType
+{
+    Empty,
+    Include,
+    Space,
+    Align,
+    Label,
+    Gap
+};
+
+// A parsed line.
+struct Statement
+{
+    StatementType type;
+    std::string name; // The label or include path.
+    unsigned long value; // The .space amount, .align amount in bytes or gap length.
+    long lineNum;
+};
+
 class SymFile
 {
 public:
-    SymFile(std::string filename);
-    SymFile(SymFile&& other);
+    SymFile(std::string filename, SymFileType type);
     SymFile(const SymFile&) = delete;
     ~SymFile();
-    Directive GetDirective();
-    std::string GetLabel(bool requireColon = true);
-    std::string ReadPath();
-    bool ReadInteger(unsigned long& value);
-    void ExpectEmptyRestOfLine();
-    void SkipLine();
-    bool IsAtEnd();
-    void HandleLangConditional(std::string lang);
-    void RaiseError(const char* format, ...);
-    void RaiseWarning(const char* format, ...);
+    SymFileType GetType() { return m_type; }
+    const std::vector<const Statement*>& GetStatements(const std::string& lang);
+    void RaiseError(const Statement& statement, const char* format, ...);
 
 private:
+    // A line outside of the # directives.
+    struct Line
+    {
+        long start;
+        long lineNum;
+        int langIndex; // -1 if the line isn't inside a language conditional.
+    };
+
     char* m_buffer;
     long m_pos;
     long m_size;
     long m_lineNum;
     long m_lineStart;
     std::string m_filename;
-    bool m_inLangConditional;
+    SymFileType m_type;
+    std::vector<Line> m_lines;
+    std::vector<std::string> m_langs;
+    std::vector<Statement> m_statements;
+    std::vector<bool> m_parsed;
+    std::unordered_map<std::string, std::vector<const Statement*>> m_langStatements;
 
+    void SplitLines();
+    void ParseLine(std::size_t index);
+    Directive GetDirective();
+    std::string GetLabel(bool requireColon = true);
+    std::string ReadPath();
+    bool ReadInteger(unsigned long& value);
+    void ExpectEmptyRestOfLine();
+    void SkipLine();
     bool ConsumeComma();
     void RemoveComments();
     bool CheckForDirective(std::string name);
     void SkipWhitespace();
-    void ReportDiagnostic(const char* type, const char* format, std::va_list args);
+    void RaiseError(const char* format, ...);
+    void RaiseWarning(const char* format, ...);
+    void ReportDiagnostic(long lineNum, const char* type, const char* format, std::va_list args);
 };
 
+SymFile& GetSymFile(std::string filename, SymFileType type);
+
 #endif // SYM_FILE_H
@@ -23,38 +23,12 @@
 #include "scaninc.h"
 #include "asm_file.h"
 
-AsmFile::AsmFile(std::string path)
+AsmFile::AsmFile(const std::string& path, const char *buffer, int size)
+    : m_buffer(buffer), m_pos(0), m_size(size), m_lineNum(1), m_path(path)
 {
-    m_path = path;
-
-    FILE *fp = std::fopen(path.c_str(), "rb");
-
-    if (fp == NULL)
-        FATAL_ERROR("Failed to open \"%s\" for reading.\n", path.c_str());
-
-    std::fseek(fp, 0, SEEK_END);
-
-    m_size = std::ftell(fp);
-
-    m_buffer = new char[m_size];
-
-    std::rewind(fp);
-
-    if (std::fread(m_buffer, m_size, 1, fp) != 1)
-        FATAL_ERROR("Failed to read \"%s\".\n", path.c_str());
-
-    std::fclose(fp);
-
-    m_pos = 0;
-    m_lineNum = 1;
-}
-
-AsmFile::~AsmFile()
-{
-    delete[] m_buffer;
 }
 
-IncDirectiveType AsmFile::ReadUntilIncDirective(std::string &path)
+IncDirectiveType AsmFile::ReadUntilIncDirective(const std::string *&path)
 {
     // At the beginning of each loop iteration, the current file position
     // should be at the start of a line or at the end of the file.
@@ -69,9 +43,9 @@ IncDirectiveType AsmFile::ReadUntilIncDirective(std::string &path)
         {
             m_pos++;
 
-            if (MatchIncDirective("incbin", path))
+            if (MatchIncDirective("incbin", 6, path))
                 incDirectiveType = IncDirectiveType::Incbin;
-            else if (MatchIncDirective("include", path))
+            else if (MatchIncDirective("include", 7, path))
                 incDirectiveType = IncDirectiveType::Include;
         }
 
@@ -107,7 +81,7 @@ IncDirectiveType AsmFile::ReadUntilIncDirective(std::string &path)
     }
 }
 
-std::string AsmFile::ReadPath()
+const std::string* AsmFile::ReadPath()
 {
     int length = 0;
     int startPos = m_pos;
@@ -138,7 +112,7 @@ std::string AsmFile::ReadPath()
             FATAL_INPUT_ERROR("path is too long");
     }
 
-    return std::string(m_buffer + startPos, length);
+    return g_paths.Intern(m_buffer + startPos, length);
 }
 
 void AsmFile::SkipEndOfLineComment()
@@ -23,6 +23,7 @@
 
 #include <string>
 #include "scaninc.h"
+#include "path_table.h"
 
 enum class IncDirectiveType
 {
@@ -31,19 +32,19 @@ enum class IncDirectiveType
     Incbin
 };
 
+// Finds the .include and .incbin directives of an assembly file in a buffer.
 class AsmFile
 {
 public:
-    AsmFile(std::string path);
-    ~AsmFile();
-    IncDirectiveType ReadUntilIncDirective(std::string& path);
+    AsmFile(const std::string& path, const char *buffer, int size);
+    IncDirectiveType ReadUntilIncDirective(const std::string*& path);
 
 private:
-    char *m_buffer;
+    const char *m_buffer;
     int m_pos;
     int m_size;
     int m_lineNum;
-    std::string m_path;
+    const std::string& m_path;
 
     int GetChar()
     {
@@ -86,9 +87,8 @@ private:
             m_pos++;
     }
 
-    bool MatchIncDirective(std::string directiveName, std::string& path)
+    bool MatchIncDirective(const char *directiveName, int length, const std::string*& path)
     {
-        int length = directiveName.length();
         int i;
 
         for (i = 0; i < length && m_pos + i < m_size; i++)
@@ -103,14 +103,14 @@ private:
         SkipTabsAndSpaces();
 
         if (GetChar() != '"')
-            FATAL_INPUT_ERROR("no path after \".%s\" directive\n", directiveName.c_str());
+            FATAL_INPUT_ERROR("no path after \".%s\" directive\n", directiveName);
 
         path = ReadPath();
 
         return true;
     }
 
-    std::string ReadPath();
+    const std::string* ReadPath();
     void SkipEndOfLineComment();
     void SkipMultiLineComment();
     void SkipString();
@@ -18,38 +18,12 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <cstring>
 #include "c_file.h"
 
-CFile::CFile(std::string path)
+CFile::CFile(const std::string& path, const char *buffer, int size)
+    : m_buffer(buffer), m_pos(0), m_size(size), m_lineNum(1), m_path(path)
 {
-    m_path = path;
-
-    FILE *fp = std::fopen(path.c_str(), "rb");
-
-    if (fp == NULL)
-        FATAL_ERROR("Failed to open \"%s\" for reading.\n", path.c_str());
-
-    std::fseek(fp, 0, SEEK_END);
-
-    m_size = std::ftell(fp);
-
-    m_buffer = new char[m_size + 1];
-    m_buffer[m_size] = 0;
-
-    std::rewind(fp);
-
-    if (std::fread(m_buffer, m_size, 1, fp) != 1)
-        FATAL_ERROR("Failed to read \"%s\".\n", path.c_str());
-
-    std::fclose(fp);
-
-    m_pos = 0;
-    m_lineNum = 1;
-}
-
-CFile::~CFile()
-{
-    delete[] m_buffer;
 }
 
 void CFile::FindIncbins()
@@ -165,15 +139,15 @@ void CFile::SkipWhitespace()
         ;
 }
 
-bool CFile::CheckIdentifier(const std::string& ident)
+bool CFile::CheckIdentifier(const char *ident, int length)
 {
-    unsigned int i;
+    int i;
 
-    for (i = 0; i < ident.length() && m_pos + i < (unsigned)m_size; i++)
+    for (i = 0; i < length && m_pos + i < m_size; i++)
         if (ident[i] != m_buffer[m_pos + i])
             return false;
 
-    return (i == ident.length());
+    return (i == length);
 }
 
 void CFile::CheckInclude()
@@ -181,21 +155,22 @@ void CFile::CheckInclude()
     if (m_buffer[m_pos] != '#')
         return;
 
-    std::string ident = "#include";
+    static const char ident[] = "#include";
+    const int length = sizeof(ident) - 1;
 
-    if (!CheckIdentifier(ident))
+    if (!CheckIdentifier(ident, length))
     {
         return;
     }
 
-    m_pos += ident.length();
+    m_pos += length;
 
     ConsumeHorizontalWhitespace();
 
-    std::string path = ReadPath();
+    const std::string* path = ReadPath();
 
-    if (!path.empty()) {
-        m_includes.emplace(path);
+    if (!path->empty()) {
+        m_includes.push_back(path);
     }
 }
 
@@ -213,12 +188,15 @@ void CFile::CheckIncbin()
             return;
     }
 
-    std::string idents[6] = { "INCBIN_S8", "INCBIN_U8", "INCBIN_S16", "INCBIN_U16", "INCBIN_S32", "INCBIN_U32" };
+    static const char *const idents[6] = { "INCBIN_S8", "INCBIN_U8", "INCBIN_S16", "INCBIN_U16", "INCBIN_S32", "INCBIN_U32" };
     int incbinType = -1;
+    int length = 0;
 
     for (int i = 0; i < 6; i++)
     {
-        if (CheckIdentifier(idents[i]))
+        length = std::strlen(idents[i]);
+
+        if (CheckIdentifier(idents[i], length))
         {
             incbinType = i;
             break;
@@ -231,7 +209,7 @@ void CFile::CheckIncbin()
     long oldPos = m_pos;
     long oldLineNum = m_lineNum;
 
-    m_pos += idents[incbinType].length();
+    m_pos += length;
 
     SkipWhitespace();
 
@@ -248,11 +226,11 @@ void CFile::CheckIncbin()
     {
         SkipWhitespace();
 
-        std::string path = ReadPath();
+        const std::string* path = ReadPath();
 
         SkipWhitespace();
 
-        m_incbins.emplace(path);
+        m_incbins.push_back(path);
 
         if (m_buffer[m_pos] != ',')
             break;
@@ -267,13 +245,14 @@ void CFile::CheckIncbin()
 
 }
 
-std::string CFile::ReadPath()
+// Returns an empty path for a <system> include.
+const std::string* CFile::ReadPath()
 {
     if (m_buffer[m_pos] != '"')
     {
         if (m_buffer[m_pos] == '<')
         {
-            return std::string();
+            return g_paths.Intern("", 0);
         }
         FATAL_INPUT_ERROR("expected '\"' or '<'");
     }
@@ -303,5 +282,5 @@ std::string CFile::ReadPath()
 
     m_pos++;
 
-    return std::string(m_buffer + startPos, m_pos - 1 - startPos);
+    return g_paths.Intern(m_buffer + startPos, m_pos - 1 - startPos);
 }
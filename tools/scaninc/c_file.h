@@ -22,36 +22,36 @@
 #define C_FILE_H
 
 #include <string>
-#include <set>
-#include <memory>
 #include "scaninc.h"
+#include "path_table.h"
 
+// Finds the includes and incbins of a C file in a buffer that is
+// followed by at least one zero byte.
 class CFile
 {
 public:
-    CFile(std::string path);
-    ~CFile();
+    CFile(const std::string& path, const char *buffer, int size);
     void FindIncbins();
-    const std::set<std::string>& GetIncbins() { return m_incbins; }
-    const std::set<std::string>& GetIncludes() { return m_includes; }
+    PathList& GetIncbins() { return m_incbins; }
+    PathList& GetIncludes() { return m_includes; }
 
 private:
-    char *m_buffer;
+    const char *m_buffer;
     int m_pos;
     int m_size;
     int m_lineNum;
-    std::string m_path;
-    std::set<std::string> m_incbins;
-    std::set<std::string> m_includes;
+    const std::string& m_path;
+    PathList m_incbins;
+    PathList m_includes;
 
     bool ConsumeHorizontalWhitespace();
     bool ConsumeNewline();
     bool ConsumeComment();
     void SkipWhitespace();
-    bool CheckIdentifier(const std::string& ident);
+    bool CheckIdentifier(const char *ident, int length);
     void CheckInclude();
     void CheckIncbin();
-    std::string ReadPath();
+    const std::string* ReadPath();
 };
 
 #endif // C_FILE_H
@@ -0,0 +1,128 @@
+// Copyright(c) 2015-2017 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <sys/stat.h>
+#include "dir_cache.h"
+
+#ifndef _MSC_VER
+#include <dirent.h>
+#endif
+
+// Checks whether a file exists. Names are matched exactly against the directory's listing,
+// but a filesystem that ignores case is also asked, as opening the file would succeed.
+bool DirectoryCache::FileExists(const std::string& path)
+{
+    std::size_t slash = path.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+    std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+
+    std::shared_ptr<const Listing> listing = GetListing(dir);
+
+    if (listing->isListed)
+    {
+        if (listing->names.count(name) != 0)
+            return true;
+        if (!listing->ignoresCase)
+            return false;
+    }
+
+    struct stat st;
+
+    m_statCalls++;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// dir is "." or ends with a slash, like the directories that FileExists lists.
+bool DirectoryCache::IgnoresCase(const std::string& dir)
+{
+    return GetListing(dir)->ignoresCase;
+}
+
+// Looks up the first entry with a letter in it with the case of its letters swapped.
+static bool CheckIgnoresCase(const std::string& dir, const std::unordered_set<std::string>& names, std::atomic<long>& statCalls)
+{
+    for (const std::string& name : names)
+    {
+        std::string swapped = name;
+
+        for (char& c : swapped)
+        {
+            if (c >= 'a' && c <= 'z')
+                c -= 'a' - 'A';
+            else if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+        }
+
+        if (swapped == name || names.count(swapped) != 0)
+            continue;
+
+        struct stat st;
+
+        statCalls++;
+        return stat(((dir == ".") ? swapped : dir + swapped).c_str(), &st) == 0;
+    }
+
+    return false;
+}
+
+std::shared_ptr<const DirectoryCache::Listing> DirectoryCache::GetListing(const std::string& dir)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_listings.find(dir);
+
+        if (it != m_listings.end())
+            return it->second;
+    }
+
+    // Read the directory without holding the lock. If another thread
+    // got there first, keep its listing.
+    std::shared_ptr<Listing> listing = std::make_shared<Listing>();
+    listing->isListed = false;
+    listing->ignoresCase = false;
+
+#ifndef _MSC_VER
+    DIR* dp = opendir(dir.c_str());
+
+    m_dirsListed++;
+
+    if (dp != nullptr)
+    {
+        struct dirent* entry;
+
+        while ((entry = readdir(dp)) != nullptr)
+            listing->names.insert(entry->d_name);
+
+        closedir(dp);
+        listing->isListed = true;
+        listing->ignoresCase = CheckIgnoresCase(dir, listing->names, m_statCalls);
+    }
+    else if (errno == ENOENT || errno == ENOTDIR)
+    {
+        // Nothing can exist under it.
+        listing->isListed = true;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_listings.insert({ dir, listing }).first->second;
+}
@@ -0,0 +1,62 @@
+// Copyright(c) 2015-2017 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef DIR_CACHE_H
+#define DIR_CACHE_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+// Answers "does this file exist?" by reading each directory once and
+// looking names up in its listing, instead of opening every candidate path.
+// Directories that can't be listed fall back to a stat per path.
+// It's safe to use from several threads.
+class DirectoryCache
+{
+public:
+    DirectoryCache() : m_dirsListed(0), m_statCalls(0) {}
+    bool FileExists(const std::string& path);
+    bool IgnoresCase(const std::string& dir);
+    long DirectoriesListed() const { return m_dirsListed; }
+    long StatCalls() const { return m_statCalls; }
+
+private:
+    struct Listing
+    {
+        bool isListed;
+        // Whether the filesystem finds names in another case, so a name that isn't
+        // in the listing could still be opened.
+        bool ignoresCase;
+        std::unordered_set<std::string> names;
+    };
+
+    std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<const Listing>> m_listings;
+    std::atomic<long> m_dirsListed;
+    std::atomic<long> m_statCalls;
+
+    std::shared_ptr<const Listing> GetListing(const std::string& dir);
+};
+
+#endif // DIR_CACHE_H
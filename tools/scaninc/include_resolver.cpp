@@ -0,0 +1,210 @@
+// Copyright(c) 2015-2017 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/stat.h>
+#include "include_resolver.h"
+#include "path_table.h"
+
+#ifndef _MSC_VER
+#include <dirent.h>
+#endif
+
+// Deep enough for any real include tree, and stops symlink loops.
+static const int kMaxIndexDepth = 16;
+
+IncludeResolver::IncludeResolver(const std::vector<std::string>& includeDirs)
+    : m_includeDirs(includeDirs), m_isIndexed(true), m_indexIgnoresCase(false), m_isIndexTruncated(false), m_dirsIndexed(0), m_indexStatCalls(0), m_resolvedCount(0)
+{
+#ifdef _MSC_VER
+    m_isIndexed = false;
+#else
+    for (std::size_t i = 0; i < m_includeDirs.size() && m_isIndexed; i++)
+    {
+        IndexDirectory(i, m_includeDirs[i], "", 0);
+
+        if (m_dirCache.IgnoresCase(m_includeDirs[i].empty() ? "." : m_includeDirs[i]))
+            m_indexIgnoresCase = true;
+    }
+#endif
+
+    if (!m_isIndexed)
+        m_index.clear();
+}
+
+void IncludeResolver::IndexDirectory(int dirIndex, const std::string& dir, const std::string& prefix, int depth)
+{
+#ifndef _MSC_VER
+    std::string path = dir + prefix;
+    DIR* dp = opendir(path.empty() ? "." : path.c_str());
+
+    m_dirsIndexed++;
+
+    if (dp == nullptr)
+    {
+        // Anything else means the directory exists but can't be listed,
+        // so fall back to checking each path.
+        if (errno != ENOENT && errno != ENOTDIR)
+            m_isIndexed = false;
+        return;
+    }
+
+    struct dirent* entry;
+
+    while ((entry = readdir(dp)) != nullptr)
+    {
+        std::string name(entry->d_name);
+
+        if (name == "." || name == "..")
+            continue;
+
+        std::string relativePath = prefix + name;
+        bool isDir;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+        if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK)
+        {
+            isDir = (entry->d_type == DT_DIR);
+        }
+        else
+#endif
+        {
+            struct stat st;
+
+            m_indexStatCalls++;
+            isDir = stat((dir + relativePath).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        m_index.emplace(relativePath, dirIndex);
+
+        if (isDir && depth < kMaxIndexDepth)
+            IndexDirectory(dirIndex, dir, relativePath + "/", depth + 1);
+        else if (isDir)
+            m_isIndexTruncated = true;
+    }
+
+    closedir(dp);
+#endif
+}
+
+// Returns whether the index can answer for the path, which it can only
+// do for plain relative paths like the ones it was built from.
+static bool IsIndexable(const std::string& path)
+{
+    std::size_t start = 0;
+
+    for (;;)
+    {
+        std::size_t end = path.find('/', start);
+        std::size_t length = (end == std::string::npos ? path.size() : end) - start;
+
+        if (length == 0)
+            return false;
+        if (length == 1 && path[start] == '.')
+            return false;
+        if (length == 2 && path[start] == '.' && path[start + 1] == '.')
+            return false;
+        if (end == std::string::npos)
+            return true;
+
+        start = end + 1;
+    }
+}
+
+Resolution IncludeResolver::Find(const std::string* srcDir, const std::string* include, bool isAsm)
+{
+    Resolution resolution;
+    std::string path;
+
+    bool useIndex = m_isIndexed && IsIndexable(*include);
+
+    resolution.candidates = 0;
+
+    if (useIndex)
+    {
+        auto it = m_index.find(*include);
+
+        if (it != m_index.end())
+        {
+            path = m_includeDirs[it->second] + *include;
+            resolution.path = g_paths.Intern(path.data(), path.size());
+            resolution.exists = true;
+            resolution.candidates = it->second + 1;
+            return resolution;
+        }
+
+        resolution.candidates = m_includeDirs.size();
+    }
+
+    // Paths with more components than the index goes down are looked for directly.
+    bool isPastIndex = m_isIndexTruncated && std::count(include->begin(), include->end(), '/') > kMaxIndexDepth;
+
+    if (!useIndex || m_indexIgnoresCase || isPastIndex)
+    {
+        resolution.candidates = 0;
+
+        for (const std::string& includeDir : m_includeDirs)
+        {
+            path = includeDir + *include;
+            resolution.candidates++;
+
+            if (m_dirCache.FileExists(path))
+            {
+                resolution.path = g_paths.Intern(path.data(), path.size());
+                resolution.exists = true;
+                return resolution;
+            }
+        }
+    }
+
+    // The including file's directory is searched last. If the include isn't
+    // found at all, C files depend on it there and assembly files depend on it as written.
+    path = *srcDir + *include;
+    resolution.candidates++;
+    resolution.exists = m_dirCache.FileExists(path);
+
+    if (!resolution.exists && isAsm)
+        path = *include;
+
+    resolution.path = g_paths.Intern(path.data(), path.size());
+    return resolution;
+}
+
+Resolution IncludeResolver::Resolve(const std::string* srcDir, const std::string* include, bool isAsm)
+{
+    Key key = { srcDir, include, isAsm };
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_resolved.find(key);
+
+        if (it != m_resolved.end())
+            return it->second;
+    }
+
+    Resolution resolution = Find(srcDir, include, isAsm);
+
+    m_resolvedCount++;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_resolved.insert({ key, resolution }).first->second;
+}
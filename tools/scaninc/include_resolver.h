@@ -0,0 +1,97 @@
+// Copyright(c) 2015-2017 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef INCLUDE_RESOLVER_H
+#define INCLUDE_RESOLVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "dir_cache.h"
+
+// What an include refers to.
+struct Resolution
+{
+    const std::string* path;
+    bool exists;
+    // How many paths trying each directory in turn would have opened.
+    int candidates;
+};
+
+// Resolves includes against the include directories and then the including
+// file's directory. Each include directory is listed once up front, so an
+// include is found with one lookup however many directories there are, and
+// each distinct include is only resolved once per directory it's included from.
+// It's safe to use from several threads.
+class IncludeResolver
+{
+public:
+    IncludeResolver(const std::vector<std::string>& includeDirs);
+    Resolution Resolve(const std::string* srcDir, const std::string* include, bool isAsm);
+    DirectoryCache& GetDirectoryCache() { return m_dirCache; }
+    long DirectoriesListed() const { return m_dirsIndexed + m_dirCache.DirectoriesListed(); }
+    long StatCalls() const { return m_indexStatCalls + m_dirCache.StatCalls(); }
+    long Resolved() const { return m_resolvedCount; }
+
+private:
+    struct Key
+    {
+        const std::string* srcDir;
+        const std::string* include;
+        bool isAsm;
+
+        bool operator==(const Key& other) const
+        {
+            return srcDir == other.srcDir && include == other.include && isAsm == other.isAsm;
+        }
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& key) const
+        {
+            std::hash<const void*> hash;
+            return hash(key.srcDir) * 31 + hash(key.include) * 2 + key.isAsm;
+        }
+    };
+
+    std::vector<std::string> m_includeDirs;
+    // Maps paths relative to the include directories to the first directory that has them.
+    std::unordered_map<std::string, int> m_index;
+    DirectoryCache m_dirCache;
+    std::mutex m_mutex;
+    std::unordered_map<Key, Resolution, KeyHash> m_resolved;
+    bool m_isIndexed;
+    // The index only has exact names, so on a filesystem that ignores case a miss isn't final.
+    bool m_indexIgnoresCase;
+    // Whether directories past kMaxIndexDepth were left out, so deeper paths can't be looked up.
+    bool m_isIndexTruncated;
+    long m_dirsIndexed;
+    long m_indexStatCalls;
+    std::atomic<long> m_resolvedCount;
+
+    void IndexDirectory(int dirIndex, const std::string& dir, const std::string& prefix, int depth);
+    Resolution Find(const std::string* srcDir, const std::string* include, bool isAsm);
+};
+
+#endif // INCLUDE_RESOLVER_H
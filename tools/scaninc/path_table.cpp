@@ -0,0 +1,94 @@
+// Copyright(c) 2015-2017 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include "path_table.h"
+
+PathTable g_paths;
+
+static std::uint32_t HashPath(const char* s, std::size_t length)
+{
+    // FNV-1a
+    std::uint32_t hash = 2166136261u;
+
+    for (std::size_t i = 0; i < length; i++)
+    {
+        hash ^= static_cast<unsigned char>(s[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+const std::string* PathTable::Intern(const char* s, std::size_t length)
+{
+    std::uint32_t hash = HashPath(s, length);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::size_t mask = m_slots.size() - 1;
+    std::size_t i = hash & mask;
+
+    while (m_slots[i] != nullptr)
+    {
+        if (m_hashes[i] == hash && m_slots[i]->size() == length && m_slots[i]->compare(0, length, s, length) == 0)
+            return m_slots[i];
+
+        i = (i + 1) & mask;
+    }
+
+    m_strings.emplace_back(s, length);
+    m_slots[i] = &m_strings.back();
+    m_hashes[i] = hash;
+
+    // Keep the table at most half full.
+    if (m_strings.size() * 2 > m_slots.size())
+        Grow();
+
+    return &m_strings.back();
+}
+
+void PathTable::Grow()
+{
+    std::vector<const std::string*> slots(m_slots.size() * 2, nullptr);
+    std::vector<std::uint32_t> hashes(m_slots.size() * 2, 0);
+    std::size_t mask = slots.size() - 1;
+
+    for (std::size_t j = 0; j < m_slots.size(); j++)
+    {
+        if (m_slots[j] == nullptr)
+            continue;
+
+        std::size_t i = m_hashes[j] & mask;
+
+        while (slots[i] != nullptr)
+            i = (i + 1) & mask;
+
+        slots[i] = m_slots[j];
+        hashes[i] = m_hashes[j];
+    }
+
+    m_slots.swap(slots);
+    m_hashes.swap(hashes);
+}
+
+void SortPaths(PathList& paths)
+{
+    std::sort(paths.begin(), paths.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+}
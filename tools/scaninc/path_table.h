@@ -0,0 +1,57 @@
+// Copyright(c) 2015-2017 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef PATH_TABLE_H
+#define PATH_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Paths found in source files, as pointers into a PathTable.
+typedef std::vector<const std::string*> PathList;
+
+// Stores each distinct path once, so that the same path found in many files
+// is only allocated the first time and paths can be compared by pointer.
+// It's safe to use from several threads.
+class PathTable
+{
+public:
+    PathTable() : m_slots(1024, nullptr), m_hashes(1024, 0) {}
+    const std::string* Intern(const char* s, std::size_t length);
+
+private:
+    std::mutex m_mutex;
+    std::deque<std::string> m_strings;
+    std::vector<const std::string*> m_slots;
+    std::vector<std::uint32_t> m_hashes;
+
+    void Grow();
+};
+
+extern PathTable g_paths;
+
+// Sorts paths by their text and removes duplicates.
+void SortPaths(PathList& paths);
+
+#endif // PATH_TABLE_H
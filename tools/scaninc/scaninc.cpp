@@ -20,37 +20,138 @@
 
 #include <cstdio>
 #include <cstdlib>
-#include <list>
-#include <queue>
 #include <set>
 #include <string>
+#include <thread>
+#include <vector>
 #include "scaninc.h"
-#include "source_file.h"
+#include "scanner.h"
+#include "profile.h"
 
-bool CanOpenFile(std::string path)
+const char *const USAGE = "Usage: scaninc [-I INCLUDE_PATH] [-j JOBS] [--db DB_PATH] [-o OUTPUT_PATH]\n"
+                          "               [-MF DEPFILE [-MT TARGET] [--ninja]] [--stats] FILE_PATH...\n"
+                          "With more than one FILE_PATH, each line is \"FILE_PATH: DEPENDENCIES\".\n"
+                          "--db keeps each file's includes in DB_PATH so that unchanged files aren't read again.\n"
+                          "-o only rewrites OUTPUT_PATH if the dependencies changed.\n"
+                          "-MF writes a make depfile for TARGET instead, which defaults to FILE_PATH with a .o extension.\n"
+                          "In DEPFILE and TARGET, %% is replaced by FILE_PATH without its extension, and\n"
+                          "DEPFILE must have one when there is more than one FILE_PATH.\n"
+                          "--ninja leaves out the empty rule make needs for each dependency.\n"
+                          "--stats prints how much work the caches saved to stderr.\n";
+
+// Writes the output unless the file already has the same contents,
+// so that make doesn't think an included fragment changed.
+void WriteIfChanged(const std::string& path, const std::string& output)
 {
     FILE *fp = std::fopen(path.c_str(), "rb");
 
+    if (fp != NULL)
+    {
+        std::string old;
+        char buffer[4096];
+        std::size_t count;
+
+        while ((count = std::fread(buffer, 1, sizeof(buffer), fp)) > 0)
+            old.append(buffer, count);
+
+        std::fclose(fp);
+
+        PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+        PROFILE_COUNT(PROFILE_BYTES_READ, old.size());
+
+        if (old == output)
+            return;
+    }
+
+    fp = std::fopen(path.c_str(), "wb");
+
     if (fp == NULL)
-        return false;
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", path.c_str());
+
+    if (std::fwrite(output.data(), 1, output.size(), fp) != output.size() || std::fclose(fp) != 0)
+        FATAL_ERROR("Failed to write \"%s\".\n", path.c_str());
 
-    std::fclose(fp);
-    return true;
+    PROFILE_COUNT(PROFILE_FILES_OPENED, 1);
+    PROFILE_COUNT(PROFILE_BYTES_WRITTEN, output.size());
 }
 
-const char *const USAGE = "Usage: scaninc [-I INCLUDE_PATH] FILE_PATH\n";
+// Returns the path without its extension.
+std::string GetStem(const std::string& path)
+{
+    std::size_t dot = path.rfind('.');
+    std::size_t slash = path.rfind('/');
 
-int main(int argc, char **argv)
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path;
+
+    return path.substr(0, dot);
+}
+
+std::string ReplaceStem(const std::string& pattern, const std::string& stem)
+{
+    std::size_t percent = pattern.find('%');
+
+    if (percent == std::string::npos)
+        return pattern;
+
+    return pattern.substr(0, percent) + stem + pattern.substr(percent + 1);
+}
+
+// Escapes a path for a depfile. Make and Ninja read the same escapes.
+std::string EscapeDepPath(const std::string& path)
 {
-    std::queue<std::string> filesToProcess;
-    std::set<std::string> dependencies;
+    std::string escaped;
 
+    for (char c : path)
+    {
+        if (c == ' ' || c == '#')
+            escaped += '\\';
+        else if (c == '$')
+            escaped += '$';
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+// Builds a depfile in the format gcc writes with -MD -MP. Ninja only wants the
+// first rule, and the empty ones stop make from failing when a header is deleted.
+std::string MakeDepfile(const std::string& target, const std::string& root, const std::set<std::string>& dependencies, bool ninja)
+{
+    std::string depfile = EscapeDepPath(target) + ": " + EscapeDepPath(root);
+
+    for (const std::string &path : dependencies)
+        depfile += " \\\n " + EscapeDepPath(path);
+
+    depfile += '\n';
+
+    if (!ninja)
+    {
+        for (const std::string &path : dependencies)
+            depfile += '\n' + EscapeDepPath(path) + ":\n";
+    }
+
+    return depfile;
+}
+
+int main(int argc, char **argv)
+{
     std::vector<std::string> includeDirs;
+    std::vector<std::string> roots;
+    unsigned int numThreads = std::thread::hardware_concurrency();
+    std::string dbPath;
+    std::string outputPath;
+    std::string depfilePattern;
+    std::string targetPattern = "%.o";
+    bool ninja = false;
+    bool stats = false;
+
+    ProfileInit("scaninc", &argc, argv);
 
     argc--;
     argv++;
 
-    while (argc > 1)
+    while (argc > 0)
     {
         std::string arg(argv[0]);
         if (arg.substr(0, 2) == "-I")
@@ -58,6 +159,8 @@ int main(int argc, char **argv)
             std::string includeDir = arg.substr(2);
             if (includeDir.empty())
             {
+                if (argc < 2)
+                    FATAL_ERROR(USAGE);
                 argc--;
                 argv++;
                 includeDir = std::string(argv[0]);
@@ -68,61 +171,118 @@ int main(int argc, char **argv)
             }
             includeDirs.push_back(includeDir);
         }
-        else
+        else if (arg == "-j")
+        {
+            if (argc < 2)
+                FATAL_ERROR(USAGE);
+            argc--;
+            argv++;
+            numThreads = std::strtoul(argv[0], nullptr, 10);
+        }
+        else if (arg == "--db" || arg == "-o")
+        {
+            if (argc < 2)
+                FATAL_ERROR(USAGE);
+            argc--;
+            argv++;
+            (arg == "--db" ? dbPath : outputPath) = argv[0];
+        }
+        else if (arg == "-MF" || arg == "-MT")
+        {
+            if (argc < 2)
+                FATAL_ERROR(USAGE);
+            argc--;
+            argv++;
+            (arg == "-MF" ? depfilePattern : targetPattern) = argv[0];
+        }
+        else if (arg == "--ninja")
+        {
+            ninja = true;
+        }
+        else if (arg == "--stats")
+        {
+            stats = true;
+        }
+        else if (arg[0] == '-')
         {
             FATAL_ERROR(USAGE);
         }
+        else
+        {
+            roots.push_back(arg);
+        }
         argc--;
         argv++;
     }
 
-    if (argc != 1) {
+    if (roots.empty()) {
         FATAL_ERROR(USAGE);
     }
 
-    std::string initialPath(argv[0]);
+    if (roots.size() > 1 && !depfilePattern.empty() && depfilePattern.find('%') == std::string::npos) {
+        FATAL_ERROR(USAGE);
+    }
+
+    DependencyScanner scanner(includeDirs);
+
+    if (!dbPath.empty())
+    {
+        ProfileScope scope("LoadDatabase", dbPath.c_str());
+        scanner.LoadDatabase(dbPath);
+    }
+
+    std::vector<std::set<std::string>> dependencies = scanner.Scan(roots, numThreads == 0 ? 1 : numThreads);
 
-    filesToProcess.push(initialPath);
+    // Failing to save the database isn't an error, since it's only an optimization.
+    if (!dbPath.empty())
+    {
+        ProfileScope scope("SaveDatabase", dbPath.c_str());
+        scanner.SaveDatabase(dbPath);
+    }
 
-    while (!filesToProcess.empty())
+    if (stats)
+        scanner.PrintStats(stderr, roots.size());
+
+    if (!depfilePattern.empty())
     {
-        std::string filePath = filesToProcess.front();
-        SourceFile file(filePath);
-        filesToProcess.pop();
+        ProfileScope scope("WriteDepfiles");
 
-        includeDirs.push_back(file.GetSrcDir());
-        for (auto incbin : file.GetIncbins())
+        for (std::size_t i = 0; i < roots.size(); i++)
         {
-            dependencies.insert(incbin);
+            std::string stem = GetStem(roots[i]);
+            WriteIfChanged(ReplaceStem(depfilePattern, stem),
+                           MakeDepfile(ReplaceStem(targetPattern, stem), roots[i], dependencies[i], ninja));
         }
-        for (auto include : file.GetIncludes())
+        return 0;
+    }
+
+    std::string output;
+
+    if (roots.size() == 1)
+    {
+        for (const std::string &path : dependencies[0])
         {
-            bool exists = false;
-            std::string path("");
-            for (auto includeDir : includeDirs)
-            {
-                path = includeDir + include;
-                if (CanOpenFile(path))
-                {
-                    exists = true;
-                    break;
-                }
-            }
-            if (!exists && (file.FileType() == SourceFileType::Asm || file.FileType() == SourceFileType::Inc))
-            {
-                path = include;
-            }
-            bool inserted = dependencies.insert(path).second;
-            if (inserted && exists)
+            output += path;
+            output += '\n';
+        }
+    }
+    else
+    {
+        for (std::size_t i = 0; i < roots.size(); i++)
+        {
+            output += roots[i];
+            output += ':';
+            for (const std::string &path : dependencies[i])
             {
-                filesToProcess.push(path);
+                output += ' ';
+                output += path;
             }
+            output += '\n';
         }
-        includeDirs.pop_back();
     }
 
-    for (const std::string &path : dependencies)
-    {
-        std::printf("%s\n", path.c_str());
-    }
+    if (outputPath.empty())
+        std::fwrite(output.data(), 1, output.size(), stdout);
+    else
+        WriteIfChanged(outputPath, output);
 }
@@ -0,0 +1,82 @@
+// Copyright(c) 2015-2017 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "include_resolver.h"
+#include "source_file.h"
+
+// The direct includes and incbins of one file.
+struct ScannedFile
+{
+    long mtime;
+    long size;
+    SourceFileType type;
+    const std::string* srcDir;
+    PathList includes;
+    PathList incbins;
+};
+
+// Finds the dependencies of many root files at once.
+// Each file is read once no matter how many roots include it, and the roots
+// are scanned on a pool of threads. With a database, files that haven't
+// changed since the last run aren't read at all.
+class DependencyScanner
+{
+public:
+    DependencyScanner(const std::vector<std::string>& includeDirs)
+        : m_resolver(includeDirs), m_dbTime(0), m_startTime(std::time(nullptr)),
+          m_visits(0), m_filesRead(0), m_dbHits(0), m_lookups(0), m_candidates(0) {}
+    void LoadDatabase(const std::string& path);
+    bool SaveDatabase(const std::string& path);
+    std::vector<std::set<std::string>> Scan(const std::vector<std::string>& roots, unsigned int numThreads);
+    std::set<std::string> ScanRoot(const std::string& root);
+    void PrintStats(FILE *fp, std::size_t numRoots);
+
+private:
+    IncludeResolver m_resolver;
+    std::mutex m_mutex;
+    std::unordered_map<const std::string*, std::shared_ptr<const ScannedFile>> m_files;
+    std::map<std::string, std::shared_ptr<const ScannedFile>> m_storedFiles;
+    long m_dbTime;
+    long m_startTime;
+
+    // For --stats.
+    std::atomic<long> m_visits;
+    std::atomic<long> m_filesRead;
+    std::atomic<long> m_dbHits;
+    std::atomic<long> m_lookups;
+    std::atomic<long> m_candidates;
+
+    std::shared_ptr<const ScannedFile> GetFile(const std::string* path);
+};
+
+#endif // SCANNER_H
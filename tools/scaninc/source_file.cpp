@@ -18,8 +18,8 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
-#include <new>
 #include "source_file.h"
+#include "mapped_file.h"
 
 
 SourceFileType GetFileType(std::string& path)
@@ -62,31 +62,41 @@ SourceFile::SourceFile(std::string path)
 
     m_src_dir = GetDir(path);
 
+    // The padding lets the lexers look a few characters ahead without checking for the end.
+    MappedFile source(path, 8);
+
+    if (!source.IsOpen())
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", path.c_str());
+
+    const char *buffer = reinterpret_cast<const char *>(source.Data());
+    int size = source.Size();
+
     if (m_file_type == SourceFileType::Cpp
             || m_file_type == SourceFileType::Header)
     {
-        new (&m_source_file.c_file) CFile(path);
-        m_source_file.c_file.FindIncbins();
+        CFile file(path, buffer, size);
+        file.FindIncbins();
+        m_incbins.swap(file.GetIncbins());
+        m_includes.swap(file.GetIncludes());
     }
     else
     {
-        AsmFile file(path);
-        std::set<std::string> incbins;
-        std::set<std::string> includes;
+        AsmFile file(path, buffer, size);
 
         IncDirectiveType incDirectiveType;
-        std::string outputPath;
+        const std::string *outputPath;
 
         while ((incDirectiveType = file.ReadUntilIncDirective(outputPath)) != IncDirectiveType::None)
         {
             if (incDirectiveType == IncDirectiveType::Include)
-                includes.insert(outputPath);
+                m_includes.push_back(outputPath);
             else
-                incbins.insert(outputPath);
+                m_incbins.push_back(outputPath);
         }
-        
-        new (&m_source_file.asm_wrapper) SourceFile::InnerUnion::AsmWrapper{incbins, includes};
     }
+
+    SortPaths(m_incbins);
+    SortPaths(m_includes);
 }
 
 SourceFileType SourceFile::FileType()
@@ -94,37 +104,17 @@ SourceFileType SourceFile::FileType()
     return m_file_type;
 }
 
-SourceFile::~SourceFile()
+const PathList& SourceFile::GetIncbins()
 {
-    if (m_file_type == SourceFileType::Cpp || m_file_type == SourceFileType::Header)
-    {
-        m_source_file.c_file.~CFile();
-    }
-    else
-    {
-        m_source_file.asm_wrapper.asm_incbins.~set();
-        m_source_file.asm_wrapper.asm_includes.~set();
-    }
+    return m_incbins;
 }
 
-const std::set<std::string>& SourceFile::GetIncbins()
+const PathList& SourceFile::GetIncludes()
 {
-    if (m_file_type == SourceFileType::Cpp || m_file_type == SourceFileType::Header)
-        return m_source_file.c_file.GetIncbins();
-    else
-        return m_source_file.asm_wrapper.asm_incbins;
-}
-
-const std::set<std::string>& SourceFile::GetIncludes()
-{
-    if (m_file_type == SourceFileType::Cpp || m_file_type == SourceFileType::Header)
-        return m_source_file.c_file.GetIncludes();
-    else
-        return m_source_file.asm_wrapper.asm_includes;
+    return m_includes;
 }
 
 std::string& SourceFile::GetSrcDir()
 {
     return m_src_dir;
 }
-
@@ -35,35 +35,26 @@ enum class SourceFileType
 };
 
 SourceFileType GetFileType(std::string& path);
+std::string GetDir(std::string& path);
 
+// The includes and incbins found in a file, sorted and without duplicates.
 class SourceFile
 {
 public:
 
     SourceFile(std::string path);
-    ~SourceFile();
     SourceFile(SourceFile const&) = delete;
     SourceFile(SourceFile&&) = delete;
     SourceFile& operator =(SourceFile const&) = delete;
     SourceFile& operator =(SourceFile&&) = delete;
-    bool HasIncbins();
-    const std::set<std::string>& GetIncbins();
-    const std::set<std::string>& GetIncludes();
+    const PathList& GetIncbins();
+    const PathList& GetIncludes();
     std::string& GetSrcDir();
     SourceFileType FileType();
 
 private:
-    union InnerUnion {
-        CFile c_file;
-        struct AsmWrapper {
-            std::set<std::string> asm_incbins;
-            std::set<std::string> asm_includes;
-        } asm_wrapper;
-
-        // Construction and destruction handled by SourceFile.
-        InnerUnion() {};
-        ~InnerUnion() {};
-    } m_source_file;
+    PathList m_incbins;
+    PathList m_includes;
     SourceFileType m_file_type;
     std::string m_src_dir;
 };